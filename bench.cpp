@@ -0,0 +1,1416 @@
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <climits>
+#include <cstdarg>
+#include <time.h>
+#include <vector>
+#include <unordered_map>
+#include <string>
+
+#include <ncurses.h>
+
+#include "db_parse.h"
+#include "db_snapshot.h"
+#include "csv.h"
+#include "heap.h"
+#include "poke327.h"
+#include "io.h"
+#include "headless.h"
+
+/* Benchmarks for the hot paths, from single functions up to whole     *
+ * headless sessions.  "make bench" builds this; run ./bench for all   *
+ * of them or ./bench <name>... for some.  Each one reports its best   *
+ * of BENCH_RUNS runs, from BENCH_SEED, so two runs of the same binary *
+ * do the same work.                                                   *
+ *                                                                     *
+ * Every timing is also kept as a result, a name and a value where     *
+ * less is better.  --json <file> writes them out, and --compare       *
+ * <file> checks them against a file written that way, flagging any   *
+ * that got more than --threshold percent (BENCH_THRESHOLD) slower.    *
+ * ./bench exits non-zero on a regression or a MISMATCH.               */
+
+#define BENCH_RUNS      5
+#define BENCH_SEED      327
+#define BENCH_THRESHOLD 10.0
+
+typedef struct bench_result {
+  char name[64];
+  char unit[12];
+  double value;
+} bench_result_t;
+
+static std::vector<bench_result_t> results;
+static uint32_t mismatches;
+
+/* name is a printf() format, so rows that come in families can be *
+ * named family/row                                                 */
+static void bench_result(double value, const char *unit,
+                         const char *name, ...)
+{
+  bench_result_t r;
+  va_list ap;
+
+  va_start(ap, name);
+  vsnprintf(r.name, sizeof (r.name), name, ap);
+  va_end(ap);
+  snprintf(r.unit, sizeof (r.unit), "%s", unit);
+  r.value = value;
+  results.push_back(r);
+}
+
+static double now_ms()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static char *csv_path(const char *name)
+{
+  char *prefix, *path;
+
+  prefix = db_csv_prefix();
+  path = (char *) malloc(strlen(prefix) + strlen(name) + 1);
+  strcpy(path, prefix);
+  strcat(path, name);
+  free(prefix);
+
+  return path;
+}
+
+/* The pokedex and the first map, shared by every bench that plays */
+static void bench_world()
+{
+  static int done;
+
+  if (!done) {
+    db_parse(false);
+    srand(BENCH_SEED);
+    init_world();
+    done = 1;
+  }
+}
+
+/* Walks east through the current map's gate, the way leave_map() would */
+static void bench_next_map()
+{
+  world.pc.pos[dim_x] = MAP_X - 2;
+  world.pc.pos[dim_y] = world.cur_map->e;
+  world.cur_idx[dim_x]++;
+  new_map(0);
+}
+
+/* The tokenizer db_parse used before csv.h, kept verbatim as the *
+ * reference: a hidden static cursor and a byte at a time.         */
+static char *old_next_token(char *start, char delim)
+{
+  int i;
+  static char *s;
+
+  if (start) {
+    s = start;
+  }
+
+  start = s;
+
+  for (i = 0; s[i] && s[i] != delim; i++)
+    ;
+  s[i] = '\0';
+  s = s + i + 1;
+
+  return start;
+}
+
+/* Both CSV readers fold every field into the same checksum, so the *
+ * comparison also checks that they agree.                          */
+static int csv_fgets(const char *path, uint64_t *sum)
+{
+  FILE *f;
+  char line[800];
+  char *tmp;
+  int rows, i;
+
+  f = fopen(path, "r");
+  fgets(line, 800, f);
+
+  for (rows = 0; fgets(line, 800, f); rows++) {
+    tmp = old_next_token(line, ',');
+    *sum = *sum * 31 + (*tmp ? atoi(tmp) : INT_MAX);
+    for (i = 1; i < 5; i++) {
+      tmp = old_next_token(NULL, ',');
+      *sum = *sum * 31 + (*tmp ? atoi(tmp) : INT_MAX);
+    }
+    tmp = old_next_token(NULL, ',');
+    *sum = *sum * 31 + ((*tmp != '\n') ? atoi(tmp) : INT_MAX);
+  }
+
+  fclose(f);
+
+  return rows;
+}
+
+static int csv_simd(const char *path, uint64_t *sum)
+{
+  csv_file_t file;
+  csv_t f;
+  csv_field_t field[6];
+  int rows, i;
+
+  csv_map(&file, path);
+  csv_init(&f, file.data, file.data + file.size);
+  csv_row(&f, field, 0);
+
+  for (rows = 0; csv_row(&f, field, 6) >= 0; rows++) {
+    for (i = 0; i < 6; i++) {
+      *sum = *sum * 31 + csv_int(field[i]);
+    }
+  }
+
+  csv_unmap(&file);
+
+  return rows;
+}
+
+static void bench_csv()
+{
+  static const struct {
+    const char *name;
+    int (*read)(const char *path, uint64_t *sum);
+  } reader[] = {
+    { "fgets+next_token+atoi", csv_fgets },
+    { "csv.h",                 csv_simd },
+  };
+  char *path;
+  FILE *f;
+  long size;
+  uint64_t sum, first_sum;
+  double start, ms, best;
+  int i, run, rows;
+
+  path = csv_path("pokemon_moves.csv");
+  if (!(f = fopen(path, "r"))) {
+    fprintf(stderr, "csv: cannot open %s\n", path);
+    free(path);
+    return;
+  }
+  fseek(f, 0, SEEK_END);
+  size = ftell(f);
+  fclose(f);
+
+  printf("csv: %s, %.1f MB\n", path, size / 1e6);
+
+  for (first_sum = 0, i = 0; i < (int) (sizeof (reader) / sizeof (reader[0]));
+       i++) {
+    for (best = 0, rows = 0, run = 0; run < BENCH_RUNS; run++) {
+      sum = 0;
+      start = now_ms();
+      rows = reader[i].read(path, &sum);
+      ms = now_ms() - start;
+      if (!run || ms < best) {
+        best = ms;
+      }
+    }
+    if (!i) {
+      first_sum = sum;
+    }
+    printf("  %-24s %8.2f ms %8.1f MB/s %8d rows%s\n", reader[i].name, best,
+           size / 1e3 / best, rows, sum == first_sum ? "" : "  MISMATCH");
+    bench_result(best, "ms", "csv/%s", reader[i].name);
+    mismatches += sum != first_sum;
+  }
+
+  free(path);
+}
+
+/* The Fibonacci-heap pathfind character.cpp used before the bucket  *
+ * queue, with its eight relaxations folded into one loop.  That code *
+ * went on relaxing out of cells it never reached, where INT_MAX +    *
+ * cost wraps negative and the subtracting comparator then corrupts   *
+ * the heap; this one stops at the first unreachable cell instead.    */
+typedef struct ref_path {
+  heap_node_t *hn;
+  uint8_t pos[2];
+} ref_path_t;
+
+static int (*ref_dist)[MAP_X];
+
+static int32_t ref_cmp(const void *key, const void *with)
+{
+  return (ref_dist[((ref_path_t *) key)->pos[dim_y]]
+                  [((ref_path_t *) key)->pos[dim_x]] -
+          ref_dist[((ref_path_t *) with)->pos[dim_y]]
+                  [((ref_path_t *) with)->pos[dim_x]]);
+}
+
+static void ref_pathfind(map_t *m, int dist[MAP_Y][MAP_X], int ct)
+{
+  static ref_path_t p[MAP_Y][MAP_X];
+  ref_path_t *c;
+  heap_t h;
+  int x, y, i, d;
+
+  ref_dist = dist;
+  for (y = 0; y < MAP_Y; y++) {
+    for (x = 0; x < MAP_X; x++) {
+      p[y][x].pos[dim_y] = y;
+      p[y][x].pos[dim_x] = x;
+      p[y][x].hn = NULL;
+      dist[y][x] = INT_MAX;
+    }
+  }
+  dist[world.pc.pos[dim_y]][world.pc.pos[dim_x]] = 0;
+
+  heap_init(&h, ref_cmp, NULL);
+  for (y = 1; y < MAP_Y - 1; y++) {
+    for (x = 1; x < MAP_X - 1; x++) {
+      if (move_cost[ct][m->map[y][x]] != INT_MAX) {
+        p[y][x].hn = heap_insert(&h, &p[y][x]);
+      }
+    }
+  }
+
+  while ((c = (ref_path_t *) heap_remove_min(&h))) {
+    c->hn = NULL;
+    if (dist[c->pos[dim_y]][c->pos[dim_x]] == INT_MAX) {
+      break;
+    }
+    d = dist[c->pos[dim_y]][c->pos[dim_x]] +
+        move_cost[ct][m->map[c->pos[dim_y]][c->pos[dim_x]]];
+    for (i = 0; i < 8; i++) {
+      y = c->pos[dim_y] + all_dirs[i][dim_y];
+      x = c->pos[dim_x] + all_dirs[i][dim_x];
+      if (p[y][x].hn && dist[y][x] > d) {
+        dist[y][x] = d;
+        heap_decrease_key_no_replace(&h, p[y][x].hn);
+      }
+    }
+  }
+  heap_delete(&h);
+}
+
+static int same_dist(int ref[MAP_Y][MAP_X], uint16_t dist[MAP_Y][MAP_X])
+{
+  int x, y;
+
+  for (y = 0; y < MAP_Y; y++) {
+    for (x = 0; x < MAP_X; x++) {
+      if (ref[y][x] == INT_MAX ? dist[y][x] != DIST_UNREACHABLE
+                               : dist[y][x] != ref[y][x]) {
+        return 0;
+      }
+    }
+  }
+
+  return 1;
+}
+
+/* Builds a row of maps from a fixed seed, then times both pathfinds *
+ * from a spread of PC positions on each.  One call is one PC turn:  *
+ * both the hiker and the rival map.  Scattered positions force a    *
+ * full search every time; the walk, where each turn is one step or  *
+ * a rest, is what pathfind() sees in play and gets repaired.        */
+#define PATH_MAPS      16
+#define PATH_POSITIONS 32
+
+static void bench_pathfind()
+{
+  static int ref_hiker[MAP_Y][MAP_X], ref_rival[MAP_Y][MAP_X];
+  pair_t pos[PATH_MAPS][PATH_POSITIONS], walk[PATH_MAPS][PATH_POSITIONS];
+  map_t *map[PATH_MAPS];
+  pair_t pc;
+  double start, dial_ms, ref_ms, walk_ms;
+  int i, j, k, run, bad;
+
+  bench_world();
+  pc[dim_x] = world.pc.pos[dim_x];
+  pc[dim_y] = world.pc.pos[dim_y];
+
+  for (i = 0; i < PATH_MAPS; i++) {
+    if (i) {
+      bench_next_map();
+    }
+    map[i] = world.cur_map;
+    for (j = 0; j < PATH_POSITIONS; j++) {
+      do {
+        pos[i][j][dim_x] = rand_range(1, MAP_X - 2);
+        pos[i][j][dim_y] = rand_range(1, MAP_Y - 2);
+      } while (move_cost[char_pc][map[i]->map[pos[i][j][dim_y]]
+                                             [pos[i][j][dim_x]]] == INT_MAX);
+    }
+    /* One rest in nine, like picking from the nine keys around '5' */
+    walk[i][0][dim_x] = pos[i][0][dim_x];
+    walk[i][0][dim_y] = pos[i][0][dim_y];
+    for (j = 1; j < PATH_POSITIONS; j++) {
+      do {
+        k = rand_range(0, 8);
+        walk[i][j][dim_x] = walk[i][j - 1][dim_x] +
+                            (k < 8 ? all_dirs[k][dim_x] : 0);
+        walk[i][j][dim_y] = walk[i][j - 1][dim_y] +
+                            (k < 8 ? all_dirs[k][dim_y] : 0);
+      } while (walk[i][j][dim_x] < 1 || walk[i][j][dim_x] > MAP_X - 2 ||
+               walk[i][j][dim_y] < 1 || walk[i][j][dim_y] > MAP_Y - 2 ||
+               move_cost[char_pc][map[i]->map[walk[i][j][dim_y]]
+                                             [walk[i][j][dim_x]]] == INT_MAX);
+    }
+  }
+
+  for (bad = 0, i = 0; i < PATH_MAPS; i++) {
+    for (j = 0; j < PATH_POSITIONS; j++) {
+      world.pc.pos[dim_x] = pos[i][j][dim_x];
+      world.pc.pos[dim_y] = pos[i][j][dim_y];
+      pathfind(map[i]);
+      ref_pathfind(map[i], ref_hiker, char_hiker);
+      ref_pathfind(map[i], ref_rival, char_rival);
+      bad += (!same_dist(ref_hiker, world.hiker_dist) ||
+              !same_dist(ref_rival, world.rival_dist));
+    }
+    for (j = 0; j < PATH_POSITIONS; j++) {
+      world.pc.pos[dim_x] = walk[i][j][dim_x];
+      world.pc.pos[dim_y] = walk[i][j][dim_y];
+      pathfind(map[i]);
+      ref_pathfind(map[i], ref_hiker, char_hiker);
+      ref_pathfind(map[i], ref_rival, char_rival);
+      bad += (!same_dist(ref_hiker, world.hiker_dist) ||
+              !same_dist(ref_rival, world.rival_dist));
+    }
+  }
+
+  for (dial_ms = ref_ms = walk_ms = 0, run = 0; run < BENCH_RUNS; run++) {
+    start = now_ms();
+    for (i = 0; i < PATH_MAPS; i++) {
+      for (j = 0; j < PATH_POSITIONS; j++) {
+        world.pc.pos[dim_x] = pos[i][j][dim_x];
+        world.pc.pos[dim_y] = pos[i][j][dim_y];
+        pathfind(map[i]);
+      }
+    }
+    if (!run || now_ms() - start < dial_ms) {
+      dial_ms = now_ms() - start;
+    }
+
+    start = now_ms();
+    for (i = 0; i < PATH_MAPS; i++) {
+      for (j = 0; j < PATH_POSITIONS; j++) {
+        world.pc.pos[dim_x] = pos[i][j][dim_x];
+        world.pc.pos[dim_y] = pos[i][j][dim_y];
+        ref_pathfind(map[i], ref_hiker, char_hiker);
+        ref_pathfind(map[i], ref_rival, char_rival);
+      }
+    }
+    if (!run || now_ms() - start < ref_ms) {
+      ref_ms = now_ms() - start;
+    }
+
+    start = now_ms();
+    for (i = 0; i < PATH_MAPS; i++) {
+      for (j = 0; j < PATH_POSITIONS; j++) {
+        world.pc.pos[dim_x] = walk[i][j][dim_x];
+        world.pc.pos[dim_y] = walk[i][j][dim_y];
+        pathfind(map[i]);
+      }
+    }
+    if (!run || now_ms() - start < walk_ms) {
+      walk_ms = now_ms() - start;
+    }
+  }
+
+  world.pc.pos[dim_x] = pc[dim_x];
+  world.pc.pos[dim_y] = pc[dim_y];
+
+  printf("pathfind: %d maps x %d PC positions, seed %d\n",
+         PATH_MAPS, PATH_POSITIONS, BENCH_SEED);
+  printf("  %-24s %8.2f us/turn\n", "fibonacci heap",
+         ref_ms * 1000 / (PATH_MAPS * PATH_POSITIONS));
+  printf("  %-24s %8.2f us/turn\n", "bucket queue",
+         dial_ms * 1000 / (PATH_MAPS * PATH_POSITIONS));
+  printf("  %-24s %8.2f us/turn\n", "bucket queue, walking",
+         walk_ms * 1000 / (PATH_MAPS * PATH_POSITIONS));
+  printf("  %d of %d distance map pairs differ%s\n", bad,
+         2 * PATH_MAPS * PATH_POSITIONS, bad ? "  MISMATCH" : "");
+  bench_result(ref_ms * 1000 / (PATH_MAPS * PATH_POSITIONS), "us/turn",
+               "pathfind/fibonacci heap");
+  bench_result(dial_ms * 1000 / (PATH_MAPS * PATH_POSITIONS), "us/turn",
+               "pathfind/bucket queue");
+  bench_result(walk_ms * 1000 / (PATH_MAPS * PATH_POSITIONS), "us/turn",
+               "pathfind/bucket queue, walking");
+  mismatches += !!bad;
+}
+
+/* A recorded heap workload.  Every insert is a new element, even when *
+ * it is a character going back into the turn queue, and an element's *
+ * seq is where it came out in the recording.  Replays order elements  *
+ * by (key, seq), which leaves every kind exactly one right answer for *
+ * each remove-min, tie order and all.                                 */
+typedef struct heap_trace_op {
+  heap_op_t op;
+  uint32_t heap;  /* Which of the log's heaps                    */
+  uint32_t elem;  /* For insert, decrease-key and remove-min      */
+  int32_t key;    /* The element's key after insert or decrease  */
+} heap_trace_op_t;
+
+typedef struct heap_trace_log {
+  const char *name;
+  int32_t (*key)(const void *datum);
+  std::vector<heap_trace_op_t> ops;
+  std::vector<uint32_t> seq;
+  uint32_t heaps, pops;
+  uint32_t count[heap_op_delete + 1];
+  std::unordered_map<const void *, uint32_t> live_heap;
+  std::unordered_map<void *, uint32_t> live_elem;
+} heap_trace_log_t;
+
+static int32_t ref_key(const void *datum)
+{
+  return ref_dist[((ref_path_t *) datum)->pos[dim_y]]
+                 [((ref_path_t *) datum)->pos[dim_x]];
+}
+
+static int32_t path_key(const void *datum)
+{
+  return ((path_t *) datum)->cost;
+}
+
+static int32_t char_turn_key(const void *datum)
+{
+  return ((character *) datum)->next_turn;
+}
+
+/* pathfind() itself runs on a bucket queue now, so its workload is *
+ * taken from the heap-based reference above.                       */
+enum {
+  log_pathfind,
+  log_dijkstra_path,
+  log_game_loop,
+  num_heap_logs
+};
+
+static heap_trace_log_t heap_log[num_heap_logs] = {
+  { "pathfind",      ref_key  },
+  { "dijkstra_path", path_key },
+  { "game_loop",     char_turn_key },
+};
+
+/* h is a heap_t or a pqueue; either way it only names the heap */
+static void heap_log_op(heap_trace_log_t *l, const void *h, heap_op_t op,
+                        void *datum)
+{
+  heap_trace_op_t o;
+
+  if (op == heap_op_init) {
+    l->live_heap[h] = l->heaps++;
+  }
+  o.op = op;
+  o.heap = l->live_heap[h];
+  o.elem = 0;
+  o.key = 0;
+
+  switch (op) {
+  case heap_op_insert:
+    o.elem = l->seq.size();
+    l->seq.push_back(UINT32_MAX);
+    l->live_elem[datum] = o.elem;
+    o.key = l->key(datum);
+    break;
+  case heap_op_decrease_key:
+    o.elem = l->live_elem[datum];
+    o.key = l->key(datum);
+    break;
+  case heap_op_remove_min:
+    o.elem = l->live_elem[datum];
+    l->live_elem.erase(datum);
+    l->seq[o.elem] = l->pops++;
+    break;
+  case heap_op_delete:
+    l->live_heap.erase(h);
+    break;
+  default:
+    break;
+  }
+
+  l->count[op]++;
+  l->ops.push_back(o);
+}
+
+static void heap_record(heap_t *h, heap_op_t op, void *datum)
+{
+  if (h->compare == ref_cmp) {
+    heap_log_op(heap_log + log_pathfind, h, op, datum);
+  }
+}
+
+static void path_record(path_queue_t *q, heap_op_t op, path_t *p)
+{
+  heap_log_op(heap_log + log_dijkstra_path, q, op, p);
+}
+
+static void turn_record(turn_queue_t *q, heap_op_t op, character *c)
+{
+  heap_log_op(heap_log + log_game_loop, q, op, c);
+}
+
+/* A random step for the PC, or a rest when it is boxed in */
+static void play_pc_step(pair_t d)
+{
+  int i, k;
+
+  d[dim_x] = world.pc.pos[dim_x];
+  d[dim_y] = world.pc.pos[dim_y];
+  for (i = 0; i < 8; i++) {
+    k = rand() & 0x7;
+    d[dim_x] = world.pc.pos[dim_x] + all_dirs[k][dim_x];
+    d[dim_y] = world.pc.pos[dim_y] + all_dirs[k][dim_y];
+    if (d[dim_x] >= 1 && d[dim_x] <= MAP_X - 2 &&
+        d[dim_y] >= 1 && d[dim_y] <= MAP_Y - 2 &&
+        !world.cur_map->cmap[d[dim_y]][d[dim_x]] &&
+        move_cost[char_pc][world.cur_map->map[d[dim_y]][d[dim_x]]] !=
+        INT_MAX) {
+      return;
+    }
+  }
+  d[dim_x] = world.pc.pos[dim_x];
+  d[dim_y] = world.pc.pos[dim_y];
+}
+
+/* game_loop() without the UI.  Everyone but the chasers starts out  *
+ * defeated, so parks, the PC wanders at random or stands still, and  *
+ * a chaser next to the PC rests instead of starting a battle.  Ends  *
+ * when the PC's turn comes up, the way it does when the PC leaves    *
+ * the map.  Returns how many of the turns were the PC's.             */
+static int play_turns(int turns, int pc_moves)
+{
+  character *c;
+  pair_t d;
+  int i, t, is_pc, pc_turns;
+
+  for (i = 0; i < world.cur_map->num_trainers; i++) {
+    if (world.cur_map->npcs[i].ctype == char_other) {
+      world.cur_map->npcs[i].defeated = 1;
+    }
+  }
+  if ((c = world.cur_map->turn.peek_min())) {
+    world.pc.next_turn = c->next_turn;
+  }
+  world.cur_map->turn.insert(&world.pc);
+
+  for (pc_turns = 0, t = 0; ; t++) {
+    c = world.cur_map->turn.remove_min();
+    is_pc = c->ctype == char_pc;
+    if (is_pc && t >= turns) {
+      break;
+    }
+    pc_turns += is_pc;
+
+    if (is_pc && pc_moves) {
+      play_pc_step(d);
+    } else if (is_pc) {
+      d[dim_x] = c->pos[dim_x];
+      d[dim_y] = c->pos[dim_y];
+    } else if ((c->ctype == char_hiker || c->ctype == char_rival) &&
+               abs(c->pos[dim_x] - world.pc.pos[dim_x]) <= 1 &&
+               abs(c->pos[dim_y] - world.pc.pos[dim_y]) <= 1) {
+      d[dim_x] = c->pos[dim_x];
+      d[dim_y] = c->pos[dim_y];
+    } else {
+      move_func[c->mtype](c, d);
+    }
+
+    world.cur_map->cmap[c->pos[dim_y]][c->pos[dim_x]] = CMAP_NONE;
+    world.cur_map->cmap[d[dim_y]][d[dim_x]] = cmap_handle(world.cur_map, c);
+    if (is_pc && pc_moves) {
+      turn_wake(world.cur_map, d, c->next_turn);
+    }
+    c->next_turn += move_cost[c->ctype][world.cur_map->map[d[dim_y]][d[dim_x]]];
+    c->pos[dim_y] = d[dim_y];
+    c->pos[dim_x] = d[dim_x];
+    if (is_pc && pc_moves) {
+      pathfind_dirty(world.cur_map);
+    }
+
+    if (!turn_park(world.cur_map, c)) {
+      world.cur_map->turn.insert(c);
+    }
+  }
+
+  return pc_turns;
+}
+
+typedef struct heap_replay_elem {
+  int32_t key;
+  uint32_t seq;
+  pqueue_node<struct heap_replay_elem> node;
+} heap_replay_elem_t;
+
+static inline int32_t heap_replay_order(const heap_replay_elem_t *a,
+                                        const heap_replay_elem_t *b)
+{
+  if (a->key != b->key) {
+    return a->key < b->key ? -1 : 1;
+  }
+
+  return a->seq < b->seq ? -1 : a->seq > b->seq;
+}
+
+/* The same order twice: through a pointer for heap.h, and as a  *
+ * functor pqueue.h can inline.                                  */
+static int32_t heap_replay_cmp(const void *key, const void *with)
+{
+  return heap_replay_order((const heap_replay_elem_t *) key,
+                           (const heap_replay_elem_t *) with);
+}
+
+struct heap_replay_compare {
+  int32_t operator()(const heap_replay_elem_t *key,
+                     const heap_replay_elem_t *with) const
+  {
+    return heap_replay_order(key, with);
+  }
+};
+
+typedef pqueue<heap_replay_elem_t, heap_replay_compare,
+               &heap_replay_elem_t::node> replay_queue_t;
+
+/* Returns how many remove-mins came back with the wrong element */
+static uint32_t heap_replay(heap_trace_log_t *l, heap_kind_t kind,
+                            uint32_t pooled, heap_t *h,
+                            heap_replay_elem_t *e, heap_node_t **hn)
+{
+  heap_trace_op_t *o, *end;
+  uint32_t bad, i;
+
+  for (i = 0; i < l->heaps; i++) {
+    h[i].compare = NULL;
+  }
+
+  for (bad = 0, o = l->ops.data(), end = o + l->ops.size(); o < end; o++) {
+    switch (o->op) {
+    case heap_op_init:
+      heap_init_kind(h + o->heap, kind, pooled, heap_replay_cmp, NULL);
+      break;
+    case heap_op_insert:
+      e[o->elem].key = o->key;
+      hn[o->elem] = heap_insert(h + o->heap, e + o->elem);
+      break;
+    case heap_op_decrease_key:
+      e[o->elem].key = o->key;
+      heap_decrease_key_no_replace(h + o->heap, hn[o->elem]);
+      break;
+    case heap_op_remove_min:
+      bad += heap_remove_min(h + o->heap) != e + o->elem;
+      break;
+    case heap_op_delete:
+      heap_delete(h + o->heap);
+      break;
+    }
+  }
+
+  /* Turn queues live as long as their maps */
+  for (i = 0; i < l->heaps; i++) {
+    if (h[i].compare) {
+      heap_delete(h + i);
+    }
+  }
+
+  return bad;
+}
+
+static uint32_t pqueue_replay(heap_trace_log_t *l, replay_queue_t *q,
+                              heap_replay_elem_t *e)
+{
+  heap_trace_op_t *o, *end;
+  uint32_t bad, i;
+
+  for (i = 0; i < l->heaps; i++) {
+    q[i].init();
+  }
+
+  for (bad = 0, o = l->ops.data(), end = o + l->ops.size(); o < end; o++) {
+    switch (o->op) {
+    case heap_op_init:
+      q[o->heap].init();
+      break;
+    case heap_op_insert:
+      e[o->elem].key = o->key;
+      q[o->heap].insert(e + o->elem);
+      break;
+    case heap_op_decrease_key:
+      e[o->elem].key = o->key;
+      q[o->heap].decrease_key(e + o->elem);
+      break;
+    case heap_op_remove_min:
+      bad += q[o->heap].remove_min() != e + o->elem;
+      break;
+    case heap_op_delete:
+      q[o->heap].destroy();
+      break;
+    }
+  }
+
+  for (i = 0; i < l->heaps; i++) {
+    q[i].destroy();
+  }
+
+  return bad;
+}
+
+/* Records every heap operation while making fresh maps (dijkstra_path *
+ * and the turn queues), running the reference pathfind on them, and   *
+ * playing turns on them, then replays each recording on every kind of *
+ * heap, with and without the node pool, and on a pqueue.  The        *
+ * Fibonacci heap.h kind, pooled, and the pqueue are the same          *
+ * algorithm, so the gap between those two rows is the cost of the     *
+ * compare pointer.                                                    */
+#define HEAP_MAPS      8
+#define HEAP_POSITIONS 4
+#define HEAP_TURNS     2000
+
+static void bench_heap()
+{
+  static int ref[MAP_Y][MAP_X];
+  std::vector<heap_replay_elem_t> elem;
+  std::vector<heap_node_t *> hn;
+  std::vector<heap_t> h;
+  std::vector<replay_queue_t> q;
+  heap_trace_log_t *l;
+  pair_t pc;
+  double start, ms, best;
+  uint32_t i, kind, pooled, bad;
+  int j, k, run;
+
+  bench_world();
+  srand(BENCH_SEED);
+
+  heap_trace = heap_record;
+  path_queue_t::trace = path_record;
+  turn_queue_t::trace = turn_record;
+  for (j = 0; j < HEAP_MAPS; j++) {
+    bench_next_map();
+    pc[dim_x] = world.pc.pos[dim_x];
+    pc[dim_y] = world.pc.pos[dim_y];
+    for (k = 0; k < HEAP_POSITIONS; k++) {
+      do {
+        world.pc.pos[dim_x] = rand_range(1, MAP_X - 2);
+        world.pc.pos[dim_y] = rand_range(1, MAP_Y - 2);
+      } while (move_cost[char_pc][world.cur_map->map[world.pc.pos[dim_y]]
+                                                    [world.pc.pos[dim_x]]] ==
+               INT_MAX);
+      ref_pathfind(world.cur_map, ref, char_hiker);
+      ref_pathfind(world.cur_map, ref, char_rival);
+    }
+    world.pc.pos[dim_x] = pc[dim_x];
+    world.pc.pos[dim_y] = pc[dim_y];
+    pathfind_dirty(world.cur_map);
+    play_turns(HEAP_TURNS, 1);
+  }
+  heap_trace = NULL;
+  path_queue_t::trace = NULL;
+  turn_queue_t::trace = NULL;
+
+  printf("heap: %d maps, %d turns each, seed %d\n",
+         HEAP_MAPS, HEAP_TURNS, BENCH_SEED);
+
+  for (i = 0; i < num_heap_logs; i++) {
+    l = heap_log + i;
+    printf("  %s: %u heaps, %u inserts, %u decrease-keys, %u remove-mins\n",
+           l->name, l->heaps, l->count[heap_op_insert],
+           l->count[heap_op_decrease_key], l->count[heap_op_remove_min]);
+
+    h.resize(l->heaps);
+    q.resize(l->heaps);
+    elem.resize(l->seq.size());
+    hn.resize(l->seq.size());
+    for (j = 0; j < (int) elem.size(); j++) {
+      elem[j].seq = l->seq[j];
+    }
+
+    for (kind = 0; kind < num_heap_kinds; kind++) {
+      for (pooled = 0; pooled < 2; pooled++) {
+        for (bad = 0, best = 0, run = 0; run < BENCH_RUNS; run++) {
+          start = now_ms();
+          bad += heap_replay(l, (heap_kind_t) kind, pooled, h.data(),
+                             elem.data(), hn.data());
+          ms = now_ms() - start;
+          if (!run || ms < best) {
+            best = ms;
+          }
+        }
+        printf("    %-10s %-8s %8.1f ns/op%s\n", heap_kind_name[kind],
+               pooled ? "pooled" : "malloc", best * 1e6 / l->ops.size(),
+               bad ? "  MISMATCH" : "");
+        bench_result(best * 1e6 / l->ops.size(), "ns/op", "heap/%s/%s/%s",
+                     l->name, heap_kind_name[kind],
+                     pooled ? "pooled" : "malloc");
+        mismatches += !!bad;
+      }
+    }
+
+    for (bad = 0, best = 0, run = 0; run < BENCH_RUNS; run++) {
+      start = now_ms();
+      bad += pqueue_replay(l, q.data(), elem.data());
+      ms = now_ms() - start;
+      if (!run || ms < best) {
+        best = ms;
+      }
+    }
+    printf("    %-10s %-8s %8.1f ns/op%s\n", "pqueue.h", "inline",
+           best * 1e6 / l->ops.size(), bad ? "  MISMATCH" : "");
+    bench_result(best * 1e6 / l->ops.size(), "ns/op", "heap/%s/pqueue.h",
+                 l->name);
+    mismatches += !!bad;
+  }
+}
+
+/* Turn throughput: game_loop() as play_turns() plays it, on a few  *
+ * fresh maps.  The PC stands still, so the distance maps are built *
+ * once per map and what is timed is the loop itself: the turn      *
+ * queue, telling the PC from NPCs, move_func and the NPC moves.    *
+ * Parked NPCs take no turns, so the time per PC turn, which is the *
+ * time per unit of game time, is reported as well.                 */
+#define TURN_MAPS  4
+#define TURN_COUNT 20000
+
+static void bench_turns()
+{
+  map_t *map[TURN_MAPS];
+  pair_t pos[TURN_MAPS];
+  double start, best;
+  int i, run, n, pc_turns;
+
+  bench_world();
+  srand(BENCH_SEED);
+
+  for (i = 0; i < TURN_MAPS; i++) {
+    bench_next_map();
+    map[i] = world.cur_map;
+    pos[i][dim_x] = world.pc.pos[dim_x];
+    pos[i][dim_y] = world.pc.pos[dim_y];
+  }
+
+  for (best = 0, run = 0; run < BENCH_RUNS; run++) {
+    start = now_ms();
+    for (n = 0, i = 0; i < TURN_MAPS; i++) {
+      world.cur_map = map[i];
+      world.pc.pos[dim_x] = pos[i][dim_x];
+      world.pc.pos[dim_y] = pos[i][dim_y];
+      pathfind_dirty(world.cur_map);
+      n += play_turns(TURN_COUNT, 0);
+    }
+    if (!run || now_ms() - start < best) {
+      best = now_ms() - start;
+      pc_turns = n;
+    }
+  }
+
+  printf("turns: %d maps x %d turns, seed %d\n",
+         TURN_MAPS, TURN_COUNT, BENCH_SEED);
+  printf("  %-24s %8.1f ns/turn %8.1f ns/PC turn\n", "game_loop, PC resting",
+         best * 1e6 / (TURN_MAPS * TURN_COUNT), best * 1e6 / pc_turns);
+  bench_result(best * 1e6 / (TURN_MAPS * TURN_COUNT), "ns/turn",
+               "turns/game_loop");
+  bench_result(best * 1e6 / pc_turns, "ns", "turns/game_loop per PC turn");
+}
+
+/* The turn queue on its own, at trainer counts well past what a map  *
+ * holds today.  Everyone starts on turn 0 and goes again after a     *
+ * move_cost drawn at random from the NPC rows, and the pqueue.h heap *
+ * and the wheel have to agree on every turn.  The wheel takes ties   *
+ * first in, first out, and a Fibonacci heap doesn't, so here the     *
+ * heap breaks ties on the order of the inserts.                      */
+typedef struct sched_elem {
+  int32_t next_turn;
+  uint32_t seq;
+  pqueue_node<struct sched_elem> node;
+  struct sched_elem *next;
+} sched_elem_t;
+
+struct sched_compare {
+  int32_t operator()(const sched_elem_t *key, const sched_elem_t *with) const
+  {
+    if (key->next_turn != with->next_turn) {
+      return key->next_turn - with->next_turn;
+    }
+
+    return key->seq < with->seq ? -1 : key->seq > with->seq;
+  }
+};
+
+struct sched_key {
+  int32_t operator()(const sched_elem_t *e) const
+  {
+    return e->next_turn;
+  }
+};
+
+typedef pqueue<sched_elem_t, sched_compare, &sched_elem_t::node>
+        sched_pqueue_t;
+typedef wheel<sched_elem_t, sched_key, &sched_elem_t::next> sched_wheel_t;
+
+#define SCHED_TURNS 100000
+
+template <class Q>
+static double sched_run(Q *q, sched_elem_t *e, int n, const int32_t *cost,
+                        uint32_t *order)
+{
+  sched_elem_t *c;
+  double start;
+  uint32_t seq;
+  int i;
+
+  q->init();
+  for (seq = 0, i = 0; i < n; i++) {
+    e[i].next_turn = 0;
+    e[i].seq = seq++;
+    q->insert(e + i);
+  }
+
+  start = now_ms();
+  for (i = 0; i < SCHED_TURNS; i++) {
+    c = q->remove_min();
+    order[i] = c - e;
+    c->next_turn += cost[i];
+    c->seq = seq++;
+    q->insert(c);
+  }
+  start = now_ms() - start;
+
+  q->destroy();
+
+  return start;
+}
+
+static void bench_sched()
+{
+  static const int count[] = { 10, 100, 1000, 10000 };
+  std::vector<sched_elem_t> e;
+  std::vector<int32_t> cost(SCHED_TURNS);
+  std::vector<uint32_t> heap_order(SCHED_TURNS), wheel_order(SCHED_TURNS);
+  sched_pqueue_t *q;
+  sched_wheel_t *w;
+  double ms, heap_ms, wheel_ms;
+  int i, run, ct, t;
+
+  srand(BENCH_SEED);
+  for (i = 0; i < SCHED_TURNS; i++) {
+    do {
+      ct = rand_range(char_hiker, char_other);
+      t = rand_range(0, num_terrain_types - 1);
+    } while (move_cost[ct][t] == INT_MAX);
+    cost[i] = move_cost[ct][t];
+  }
+
+  q = (sched_pqueue_t *) malloc(sizeof (*q));
+  w = (sched_wheel_t *) malloc(sizeof (*w));
+
+  printf("sched: %d turns, seed %d\n", SCHED_TURNS, BENCH_SEED);
+  for (i = 0; i < (int) (sizeof (count) / sizeof (count[0])); i++) {
+    e.resize(count[i]);
+    for (heap_ms = wheel_ms = 0, run = 0; run < BENCH_RUNS; run++) {
+      ms = sched_run(q, e.data(), count[i], cost.data(), heap_order.data());
+      if (!run || ms < heap_ms) {
+        heap_ms = ms;
+      }
+      ms = sched_run(w, e.data(), count[i], cost.data(), wheel_order.data());
+      if (!run || ms < wheel_ms) {
+        wheel_ms = ms;
+      }
+    }
+    printf("  %5d trainers  pqueue.h %6.1f ns/turn  wheel.h %6.1f ns/turn%s\n",
+           count[i], heap_ms * 1e6 / SCHED_TURNS, wheel_ms * 1e6 / SCHED_TURNS,
+           heap_order == wheel_order ? "" : "  MISMATCH");
+    bench_result(heap_ms * 1e6 / SCHED_TURNS, "ns/turn", "sched/%d/pqueue.h",
+                 count[i]);
+    bench_result(wheel_ms * 1e6 / SCHED_TURNS, "ns/turn", "sched/%d/wheel.h",
+                 count[i]);
+    mismatches += heap_order != wheel_order;
+  }
+
+  free(q);
+  free(w);
+}
+
+/* The pokedex both ways db_parse() loads it: parsed from the CSV files *
+ * and indexed, and mapped from the snapshot.  Nothing else ever loads  *
+ * it twice, so each run leaks the tables the one before it left.      */
+static void bench_db()
+{
+  char *prefix;
+  double start, ms, csv_ms, snap_ms;
+  int run, snap;
+
+  bench_world();
+  prefix = db_csv_prefix();
+
+  for (csv_ms = snap_ms = 0, snap = 1, run = 0; run < BENCH_RUNS; run++) {
+    start = now_ms();
+    db_parse_csv(prefix, false);
+    ms = now_ms() - start;
+    if (!run || ms < csv_ms) {
+      csv_ms = ms;
+    }
+
+    start = now_ms();
+    snap = snap && !db_snapshot_load(prefix);
+    ms = now_ms() - start;
+    if (!run || ms < snap_ms) {
+      snap_ms = ms;
+    }
+  }
+
+  printf("db: %s\n", prefix);
+  printf("  %-24s %8.2f ms\n", "CSV files", csv_ms);
+  bench_result(csv_ms, "ms", "db/csv");
+  if (snap) {
+    printf("  %-24s %8.2f ms\n", "snapshot", snap_ms);
+    bench_result(snap_ms, "ms", "db/snapshot");
+  } else {
+    printf("  %-24s %8s\n", "snapshot", "none");
+  }
+
+  free(prefix);
+}
+
+/* create_pokemon() on maps at a few distances from the center, where *
+ * levels, and so the learnset walk, differ                           */
+#define POKEMON_COUNT 50000
+
+static void bench_pokemon()
+{
+  static const int out[] = { 0, 50, 200 };
+  pair_t idx;
+  double start, best;
+  int i, j, run;
+
+  bench_world();
+  idx[dim_x] = world.cur_idx[dim_x];
+  idx[dim_y] = world.cur_idx[dim_y];
+
+  printf("pokemon: %d each, seed %d\n", POKEMON_COUNT, BENCH_SEED);
+  for (i = 0; i < (int) (sizeof (out) / sizeof (out[0])); i++) {
+    world.cur_idx[dim_x] = WORLD_SIZE / 2 + out[i];
+    world.cur_idx[dim_y] = WORLD_SIZE / 2;
+    for (best = 0, run = 0; run < BENCH_RUNS; run++) {
+      srand(BENCH_SEED);
+      start = now_ms();
+      for (j = 0; j < POKEMON_COUNT; j++) {
+        create_pokemon();
+      }
+      if (!run || now_ms() - start < best) {
+        best = now_ms() - start;
+      }
+    }
+    printf("  %3d maps out %16s %8.2f us/pokemon\n", out[i], "",
+           best * 1000 / POKEMON_COUNT);
+    bench_result(best * 1000 / POKEMON_COUNT, "us", "pokemon/%d maps out",
+                 out[i]);
+  }
+
+  world.cur_idx[dim_x] = idx[dim_x];
+  world.cur_idx[dim_y] = idx[dim_y];
+}
+
+/* Map generation: new_map() whole, characters and their pokemon      *
+ * included, on a row of maps from a fresh world, and then its three  *
+ * costliest steps one at a time on a scratch map.  build_paths() is  *
+ * timed on terrain without boulders and trees, which only ever makes *
+ * its search a little longer.                                        */
+#define MAPGEN_MAPS 16
+
+static void bench_mapgen()
+{
+  map_t *m;
+  double start, ms, best[4], t[4];
+  int i, run;
+
+  bench_world();
+  m = (map_t *) malloc(sizeof (*m));
+
+  for (run = 0; run < BENCH_RUNS; run++) {
+    delete_world();
+    srand(BENCH_SEED);
+    init_world();
+    start = now_ms();
+    for (i = 0; i < MAPGEN_MAPS; i++) {
+      bench_next_map();
+    }
+    t[0] = now_ms() - start;
+
+    srand(BENCH_SEED);
+    for (t[1] = t[2] = t[3] = 0, i = 0; i < MAPGEN_MAPS; i++) {
+      start = now_ms();
+      smooth_height(m);
+      ms = now_ms();
+      t[1] += ms - start;
+      map_terrain(m, 3 + rand() % (MAP_X - 6), 3 + rand() % (MAP_X - 6),
+                  3 + rand() % (MAP_Y - 6), 3 + rand() % (MAP_Y - 6));
+      start = now_ms();
+      t[2] += start - ms;
+      build_paths(m);
+      t[3] += now_ms() - start;
+    }
+
+    for (i = 0; i < 4; i++) {
+      if (!run || t[i] < best[i]) {
+        best[i] = t[i];
+      }
+    }
+  }
+  free(m);
+
+  printf("mapgen: %d maps, seed %d\n", MAPGEN_MAPS, BENCH_SEED);
+  printf("  %-24s %8.1f us/map\n", "new_map",
+         best[0] * 1000 / MAPGEN_MAPS);
+  printf("  %-24s %8.1f us/map\n", "smooth_height",
+         best[1] * 1000 / MAPGEN_MAPS);
+  printf("  %-24s %8.1f us/map\n", "map_terrain",
+         best[2] * 1000 / MAPGEN_MAPS);
+  printf("  %-24s %8.1f us/map\n", "build_paths",
+         best[3] * 1000 / MAPGEN_MAPS);
+  bench_result(best[0] * 1000 / MAPGEN_MAPS, "us", "mapgen/new_map");
+  bench_result(best[1] * 1000 / MAPGEN_MAPS, "us", "mapgen/smooth_height");
+  bench_result(best[2] * 1000 / MAPGEN_MAPS, "us", "mapgen/map_terrain");
+  bench_result(best[3] * 1000 / MAPGEN_MAPS, "us", "mapgen/build_paths");
+}
+
+/* io_display() on a screen that writes to /dev/null.  It clear()s   *
+ * first, so each frame is drawn and sent in full, as in the game.   *
+ * The terminal type is fixed so the escapes sent are the same       *
+ * wherever this runs.                                               */
+#define DISPLAY_FRAMES 500
+#define DISPLAY_TERM   "xterm"
+
+static void bench_display()
+{
+  SCREEN *scr;
+  FILE *out;
+  double start, best;
+  int i, run;
+
+  bench_world();
+  if (!(out = fopen("/dev/null", "w")) ||
+      !(scr = newterm(DISPLAY_TERM, out, stdin))) {
+    fprintf(stderr, "display: no %s terminal\n", DISPLAY_TERM);
+    if (out) {
+      fclose(out);
+    }
+    return;
+  }
+  start_color();
+  for (i = COLOR_RED; i <= COLOR_WHITE; i++) {
+    init_pair(i, i, COLOR_BLACK);
+  }
+
+  for (best = 0, run = 0; run < BENCH_RUNS; run++) {
+    start = now_ms();
+    for (i = 0; i < DISPLAY_FRAMES; i++) {
+      io_display();
+    }
+    if (!run || now_ms() - start < best) {
+      best = now_ms() - start;
+    }
+  }
+
+  endwin();
+  delscreen(scr);
+  fclose(out);
+
+  printf("display: %d frames, %s\n", DISPLAY_FRAMES, DISPLAY_TERM);
+  printf("  %-24s %8.1f us/frame\n", "io_display", best * 1000 / DISPLAY_FRAMES);
+  bench_result(best * 1000 / DISPLAY_FRAMES, "us", "display/io_display");
+}
+
+/* A whole game as --headless explore plays it, from a fresh world:  *
+ * new maps, pathfinding, everyone's turns and the explorer itself.  *
+ * It leaves the game headless, so it goes last.                     */
+#define SESSION_TURNS 2000
+
+static void bench_session()
+{
+  double start, best;
+  uint64_t turns;
+  int run, x, y, maps;
+
+  bench_world();
+
+  for (best = 0, run = 0; run < BENCH_RUNS; run++) {
+    delete_world();
+    srand(BENCH_SEED);
+    init_world();
+    world.pokemon_pc[0] = create_pokemon();
+    headless_init("explore", SESSION_TURNS);
+    game_turns = 0;
+    start = now_ms();
+    game_loop();
+    if (!run || now_ms() - start < best) {
+      best = now_ms() - start;
+      turns = game_turns;
+    }
+  }
+
+  for (maps = 0, y = 0; y < WORLD_SIZE; y++) {
+    for (x = 0; x < WORLD_SIZE; x++) {
+      maps += !!world.world[y][x];
+    }
+  }
+
+  printf("session: %d PC turns of explore, seed %d\n", SESSION_TURNS,
+         BENCH_SEED);
+  printf("  %-24s %8.1f us/PC turn %8.1f ns/turn %6d maps\n", "game_loop",
+         best * 1000 / SESSION_TURNS, best * 1e6 / turns, maps);
+  bench_result(best * 1000 / SESSION_TURNS, "us", "session/per PC turn");
+  bench_result(best * 1e6 / turns, "ns", "session/per turn");
+}
+
+static const struct {
+  const char *name;
+  void (*run)();
+} benches[] = {
+  { "csv",      bench_csv },
+  { "pathfind", bench_pathfind },
+  { "heap",     bench_heap },
+  { "sched",    bench_sched },
+  { "turns",    bench_turns },
+  { "db",       bench_db },
+  { "pokemon",  bench_pokemon },
+  { "mapgen",   bench_mapgen },
+  { "display",  bench_display },
+  { "session",  bench_session },
+};
+
+#define NUM_BENCHES (sizeof (benches) / sizeof (benches[0]))
+
+/* One result per line, so bench_compare() can read it back with scanf *
+ * rather than a JSON parser.  Names never hold quotes or backslashes.  */
+static int bench_write_json(const char *path)
+{
+  FILE *f;
+  uint32_t i;
+
+  if (!(f = fopen(path, "w"))) {
+    perror(path);
+    return -1;
+  }
+
+  fprintf(f, "{\n  \"seed\": %d,\n  \"runs\": %d,\n  \"mismatches\": %u,\n"
+          "  \"results\": [\n", BENCH_SEED, BENCH_RUNS, mismatches);
+  for (i = 0; i < results.size(); i++) {
+    fprintf(f, "    { \"name\": \"%s\", \"value\": %.6g, \"unit\": \"%s\" }%s\n",
+            results[i].name, results[i].value, results[i].unit,
+            i + 1 < results.size() ? "," : "");
+  }
+  fprintf(f, "  ]\n}\n");
+  fclose(f);
+
+  return 0;
+}
+
+/* Matches results to the baseline's by name; those in only one of the  *
+ * two are listed but can't regress.  Returns the number of regressions *
+ * or -1 if the baseline can't be read.                                 */
+static int bench_compare(const char *path, double threshold)
+{
+  std::unordered_map<std::string, double> base;
+  char line[256], name[64];
+  double v, change;
+  FILE *f;
+  uint32_t i;
+  int regressions;
+
+  if (!(f = fopen(path, "r"))) {
+    perror(path);
+    return -1;
+  }
+  while (fgets(line, sizeof (line), f)) {
+    if (sscanf(line, " { \"name\": \"%63[^\"]\", \"value\": %lf", name, &v) ==
+        2) {
+      base[name] = v;
+    }
+  }
+  fclose(f);
+
+  printf("compare: against %s, %.0f%% threshold\n", path, threshold);
+  for (regressions = 0, i = 0; i < results.size(); i++) {
+    if (!base.count(results[i].name)) {
+      printf("  %-44s %10s %10.4g %s  new\n", results[i].name, "",
+             results[i].value, results[i].unit);
+      continue;
+    }
+    v = base[results[i].name];
+    base.erase(results[i].name);
+    change = v > 0 ? (results[i].value - v) * 100 / v : 0;
+    printf("  %-44s %10.4g %10.4g %s %+6.1f%%%s\n", results[i].name, v,
+           results[i].value, results[i].unit, change,
+           change > threshold ? "  REGRESSION" : "");
+    regressions += change > threshold;
+  }
+  for (std::unordered_map<std::string, double>::iterator it = base.begin();
+       it != base.end(); it++) {
+    printf("  %-44s %10.4g %10s  not run\n", it->first.c_str(), it->second,
+           "");
+  }
+  printf("  %d regression%s\n", regressions, regressions == 1 ? "" : "s");
+
+  return regressions;
+}
+
+static void usage(const char *name)
+{
+  uint32_t i;
+
+  fprintf(stderr, "Usage: %s [--json <file>] [--compare <baseline>] "
+          "[--threshold <percent>] [", name);
+  for (i = 0; i < NUM_BENCHES; i++) {
+    fprintf(stderr, "%s%s", i ? "|" : "", benches[i].name);
+  }
+  fprintf(stderr, "]...\n");
+  exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+  const char *json, *compare;
+  double threshold;
+  bool want[NUM_BENCHES] = { false };
+  uint32_t i;
+  int j, selected, rc;
+
+  json = compare = NULL;
+  threshold = BENCH_THRESHOLD;
+
+  for (selected = 0, j = 1; j < argc; j++) {
+    if (!strcmp(argv[j], "--json") && j + 1 < argc) {
+      json = argv[++j];
+    } else if (!strcmp(argv[j], "--compare") && j + 1 < argc) {
+      compare = argv[++j];
+    } else if (!strcmp(argv[j], "--threshold") && j + 1 < argc) {
+      if (sscanf(argv[++j], "%lf", &threshold) != 1 || threshold < 0) {
+        usage(argv[0]);
+      }
+    } else {
+      for (i = 0; i < NUM_BENCHES && strcmp(argv[j], benches[i].name); i++)
+        ;
+      if (i == NUM_BENCHES) {
+        usage(argv[0]);
+      }
+      want[i] = true;
+      selected++;
+    }
+  }
+
+  for (i = 0; i < NUM_BENCHES; i++) {
+    if (!selected || want[i]) {
+      benches[i].run();
+    }
+  }
+
+  rc = mismatches ? 1 : 0;
+  if (json && bench_write_json(json)) {
+    rc = 1;
+  }
+  if (compare && bench_compare(compare, threshold)) {
+    rc = 1;
+  }
+
+  return rc;
+}
@@ -1,7 +1,11 @@
+#include <stdio.h>
 #include <limits.h>
+#include <string.h>
 
 #include "poke327.h"
 #include "io.h"
+#include "prof.h"
+#include "trace.h"
 
 /***********************************************************************
  * Hack: Avoid the "path to a building" issue by making building cells *
@@ -24,17 +28,61 @@ const char *char_type_name[num_character_types] = {
   "Trainer",
 };
 
+/* Takes the flow field's step if one of the best directions is free:   *
+ * the last of them, going round from base, for hikers and the first    *
+ * for rivals, exactly what the full scans below would settle on.  With *
+ * no flow or every best direction blocked, returns false and leaves    *
+ * the choice to the scan.                                              */
+static bool flow_step(character *c, pair_t dest,
+                      uint8_t flow[MAP_Y][MAP_X], int base, bool last)
+{
+  int i, j, found;
+  uint8_t f;
+
+  f = flow[c->pos[dim_y]][c->pos[dim_x]];
+  for (found = -1, i = base; f && i < 8 + base; i++) {
+    j = i & 0x7;
+    if (!(f & (1 << j))) {
+      continue;
+    }
+    f &= ~(1 << j);
+    if (!world.cur_map->cmap[c->pos[dim_y] + all_dirs[j][dim_y]]
+                            [c->pos[dim_x] + all_dirs[j][dim_x]]) {
+      found = j;
+      if (!last) {
+        break;
+      }
+    }
+  }
+
+  if (found < 0) {
+    return false;
+  }
+
+  dest[dim_x] = c->pos[dim_x] + all_dirs[found][dim_x];
+  dest[dim_y] = c->pos[dim_y] + all_dirs[found][dim_y];
+
+  return true;
+}
+
 static void move_hiker_func(character *c, pair_t dest)
 {
   int min;
   int base;
   int i;
 
+  pathfind_update();
+
   base = rand() & 0x7;
 
   dest[dim_x] = c->pos[dim_x];
   dest[dim_y] = c->pos[dim_y];
-  min = INT_MAX;
+
+  if (flow_step(c, dest, world.hiker_flow, base, true)) {
+    return;
+  }
+
+  min = DIST_UNREACHABLE;
   
   for (i = base; i < 8 + base; i++) {
     if ((world.hiker_dist[c->pos[dim_y] + all_dirs[i & 0x7][dim_y]]
@@ -49,6 +97,9 @@ static void move_hiker_func(character *c, pair_t dest)
     if (world.hiker_dist[c->pos[dim_y] + all_dirs[i & 0x7][dim_y]]
                         [c->pos[dim_x] + all_dirs[i & 0x7][dim_x]] == 0) {
       io_battle(c, &world.pc);
+      /* dest may still be the first cell looked at, wall or not */
+      dest[dim_x] = c->pos[dim_x];
+      dest[dim_y] = c->pos[dim_y];
       break;
     }
   }
@@ -60,11 +111,18 @@ static void move_rival_func(character *c, pair_t dest)
   int base;
   int i;
   
+  pathfind_update();
+
   base = rand() & 0x7;
 
   dest[dim_x] = c->pos[dim_x];
   dest[dim_y] = c->pos[dim_y];
-  min = INT_MAX;
+
+  if (flow_step(c, dest, world.rival_flow, base, false)) {
+    return;
+  }
+
+  min = DIST_UNREACHABLE;
   
   for (i = base; i < 8 + base; i++) {
     if ((world.rival_dist[c->pos[dim_y] + all_dirs[i & 0x7][dim_y]]
@@ -94,7 +152,7 @@ static void move_pacer_func(character *c, pair_t dest)
   if (!n->defeated &&
       world.cur_map->cmap[n->pos[dim_y] + n->dir[dim_y]]
                          [n->pos[dim_x] + n->dir[dim_x]] ==
-      &world.pc) {
+      CMAP_PC) {
       io_battle(c, &world.pc);
       return;
   }
@@ -128,7 +186,7 @@ static void move_wanderer_func(character *c, pair_t dest)
   if (!n->defeated &&
       world.cur_map->cmap[n->pos[dim_y] + n->dir[dim_y]]
                          [n->pos[dim_x] + n->dir[dim_x]] ==
-      &world.pc) {
+      CMAP_PC) {
       io_battle(c, &world.pc);
       return;
   }
@@ -168,7 +226,7 @@ static void move_walker_func(character *c, pair_t dest)
   if (!n->defeated &&
       world.cur_map->cmap[n->pos[dim_y] + n->dir[dim_y]]
                          [n->pos[dim_x] + n->dir[dim_x]] ==
-      &world.pc) {
+      CMAP_PC) {
       io_battle(c, &world.pc);
       return;
   }
@@ -211,250 +269,415 @@ void (*move_func[num_movement_types])(character *, pair_t) = {
   move_pc_func,
 };
 
-int32_t cmp_char_turns(const void *key, const void *with)
+const char *movement_type_name[num_movement_types] = {
+  "move hiker",
+  "move rival",
+  "move pacer",
+  "move wanderer",
+  "move sentry",
+  "move walker",
+  "move pc",
+};
+
+pokemon_t *char_party(character *c)
 {
-  return ((character *) key)->next_turn - ((character *) with)->next_turn;
+  /* The PC's party is world.pokemon_pc */
+  static pokemon_t none[6];
+
+  if (c->ctype == char_pc) {
+    return none;
+  }
+
+  return world.cur_map->party[(npc *) c - world.cur_map->npcs];
 }
 
-void delete_character(void *v)
+/* Parking.  A sentry never moves, and a defeated trainer has nobody to *
+ * battle, so neither has anything to do with its turn; taking it anyway *
+ * costs a trip through the turn queue and a move_func call each time.   *
+ * turn_park() keeps such NPCs out of the queue instead, and turn_wake() *
+ * puts a defeated one back when the PC steps next to it, so it can get  *
+ * out of the way.  It parks again once the PC has moved on.  A map's    *
+ * turns then cost in proportion to the NPCs still in play on it.        */
+static struct {
+  uint32_t parked, woken;
+} turn_count;
+
+bool turn_park(map_t *m, character *c)
 {
-  if (v != &world.pc) {
-    delete((character *) v);
+  npc *n;
+
+  if (c->ctype == char_pc) {
+    return false;
+  }
+  n = (npc *) c;
+  if (n->mtype != move_sentry &&
+      (!n->defeated ||
+       (abs(n->pos[dim_x] - world.pc.pos[dim_x]) <= 1 &&
+        abs(n->pos[dim_y] - world.pc.pos[dim_y]) <= 1))) {
+    return false;
   }
-}
 
-#define ter_cost(x, y, c) move_cost[c][m->map[y][x]]
+  n->parked = 1;
+  m->num_parked++;
+  turn_count.parked++;
 
-static int32_t hiker_cmp(const void *key, const void *with) {
-  return (world.hiker_dist[((path_t *) key)->pos[dim_y]]
-                          [((path_t *) key)->pos[dim_x]] -
-          world.hiker_dist[((path_t *) with)->pos[dim_y]]
-                          [((path_t *) with)->pos[dim_x]]);
+  return true;
 }
 
-static int32_t rival_cmp(const void *key, const void *with) {
-  return (world.rival_dist[((path_t *) key)->pos[dim_y]]
-                          [((path_t *) key)->pos[dim_x]] -
-          world.rival_dist[((path_t *) with)->pos[dim_y]]
-                          [((path_t *) with)->pos[dim_x]]);
+/* Brings back the parked NPCs around at, to move at time when, which *
+ * must not be before the turn being taken.                           */
+void turn_wake(map_t *m, pair_t at, int32_t when)
+{
+  character *c;
+  npc *n;
+  int i;
+
+  for (i = 0; i < 8; i++) {
+    c = cmap_char(m, m->cmap[at[dim_y] + all_dirs[i][dim_y]]
+                            [at[dim_x] + all_dirs[i][dim_x]]);
+    if (!c || c->ctype == char_pc) {
+      continue;
+    }
+    n = (npc *) c;
+    if (n->parked && n->mtype != move_sentry) {
+      n->parked = 0;
+      n->next_turn = when;
+      m->num_parked--;
+      m->turn.insert(n);
+      turn_count.woken++;
+    }
+  }
 }
 
-void pathfind(map_t *m)
-{
-  heap_t h;
-  uint32_t x, y;
-  static path_t p[MAP_Y][MAP_X], *c;
-  static uint32_t initialized = 0;
+/* Past TURN_STATS_MAPS maps, as a headless run makes, only the totals */
+#define TURN_STATS_MAPS 16
 
-  if (!initialized) {
-    initialized = 1;
-    for (y = 0; y < MAP_Y; y++) {
-      for (x = 0; x < MAP_X; x++) {
-        p[y][x].pos[dim_y] = y;
-        p[y][x].pos[dim_x] = x;
+void turn_print_stats(FILE *f)
+{
+  int x, y, maps, active, parked;
+  map_t *m;
+
+  for (maps = active = parked = 0, y = 0; y < WORLD_SIZE; y++) {
+    for (x = 0; x < WORLD_SIZE; x++) {
+      if ((m = world.world[y][x])) {
+        maps++;
+        active += m->num_trainers - m->num_parked;
+        parked += m->num_parked;
       }
     }
   }
 
-  for (y = 0; y < MAP_Y; y++) {
-    for (x = 0; x < MAP_X; x++) {
-      world.hiker_dist[y][x] = world.rival_dist[y][x] = INT_MAX;
+  fprintf(f, "Parking: %u NPCs parked, %u woken\n",
+          turn_count.parked, turn_count.woken);
+  if (maps > TURN_STATS_MAPS) {
+    fprintf(f, "  %d maps: %d NPCs active, %d parked\n",
+            maps, active, parked);
+    return;
+  }
+  for (y = 0; y < WORLD_SIZE; y++) {
+    for (x = 0; x < WORLD_SIZE; x++) {
+      if ((m = world.world[y][x])) {
+        fprintf(f, "  Map (%d, %d): %d NPCs active, %d parked\n",
+                x - WORLD_SIZE / 2, y - WORLD_SIZE / 2,
+                m->num_trainers - m->num_parked, m->num_parked);
+      }
     }
   }
-  world.hiker_dist[world.pc.pos[dim_y]][world.pc.pos[dim_x]] = 
-    world.rival_dist[world.pc.pos[dim_y]][world.pc.pos[dim_x]] = 0;
+}
 
-  heap_init(&h, hiker_cmp, NULL);
+/* Builds m->path_cost from the finished terrain: move_cost squeezed to  *
+ * a byte, with the border walled off, since nothing paths through it.   *
+ * The pathfinder then reads one flat array and needs no bounds checks.  */
+void map_path_costs(map_t *m)
+{
+  int c, x, y;
+  TRACE_SCOPE("map_path_costs", "map");
 
-  for (y = 1; y < MAP_Y - 1; y++) {
-    for (x = 1; x < MAP_X - 1; x++) {
-      if (ter_cost(x, y, char_hiker) != INT_MAX) {
-        p[y][x].hn = heap_insert(&h, &p[y][x]);
-      } else {
-        p[y][x].hn = NULL;
+  for (c = 0; c < num_character_types; c++) {
+    for (y = 0; y < MAP_Y; y++) {
+      for (x = 0; x < MAP_X; x++) {
+        m->path_cost[c][y][x] =
+          (x < 1 || x > MAP_X - 2 || y < 1 || y > MAP_Y - 2 ||
+           move_cost[c][m->map[y][x]] == INT_MAX) ? PATH_IMPASSABLE :
+                                                    move_cost[c][m->map[y][x]];
       }
     }
   }
+}
 
-  while ((c = (path_t *) heap_remove_min(&h))) {
-    c->hn = NULL;
-    if ((p[c->pos[dim_y] - 1][c->pos[dim_x] - 1].hn) &&
-        (world.hiker_dist[c->pos[dim_y] - 1][c->pos[dim_x] - 1] >
-         world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker))) {
-      world.hiker_dist[c->pos[dim_y] - 1][c->pos[dim_x] - 1] =
-        world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] - 1][c->pos[dim_x] - 1].hn);
-    }
-    if ((p[c->pos[dim_y] - 1][c->pos[dim_x]    ].hn) &&
-        (world.hiker_dist[c->pos[dim_y] - 1][c->pos[dim_x]    ] >
-         world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker))) {
-      world.hiker_dist[c->pos[dim_y] - 1][c->pos[dim_x]    ] =
-        world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] - 1][c->pos[dim_x]    ].hn);
-    }
-    if ((p[c->pos[dim_y] - 1][c->pos[dim_x] + 1].hn) &&
-        (world.hiker_dist[c->pos[dim_y] - 1][c->pos[dim_x] + 1] >
-         world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker))) {
-      world.hiker_dist[c->pos[dim_y] - 1][c->pos[dim_x] + 1] =
-        world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] - 1][c->pos[dim_x] + 1].hn);
+/* Every finite move cost is at most 50, so at any point the queued *
+ * distances all lie within 50 of the one being settled.  A ring of  *
+ * DIAL_BUCKETS buckets, one per distance mod DIAL_BUCKETS, is then a *
+ * complete priority queue (Dial's algorithm).  Cells are linked into *
+ * the buckets through static next/prev arrays, so a search allocates *
+ * nothing and a decrease-key is an unlink and a relink.              */
+#define DIAL_BUCKETS 64
+#define DIAL_NONE    -1
+
+typedef enum dial_state {
+  dial_unseen,
+  dial_queued,
+  dial_done
+} dial_state_t;
+
+/* all_dirs, in the same order, as steps through a flat MAP_Y * MAP_X array */
+static constexpr int flat_dirs[8] = {
+  -MAP_X - 1, -1, MAP_X - 1,
+  -MAP_X,         MAP_X,
+  -MAP_X + 1,  1, MAP_X + 1,
+};
+
+/* One search from from, instantiated per chasing character type; a new *
+ * chaser is one more dial_pathfind<char_whatever>() in pathfind_update(). *
+ *                                                                       *
+ * With seed non-NULL, dist must hold the distances from seed, one step  *
+ * away from from, on this same map.  Where ct can stand on seed, a path *
+ * can always step back onto it, so from's cost plus the old distance is *
+ * an upper bound on every new distance.  The search starts from those   *
+ * bounds, and only cells whose distance really goes down are ever       *
+ * queued; everything on the far side of seed is right as soon as it is  *
+ * seeded.  The PC can stand where ct can't, though; then the old search *
+ * never left seed, and seed itself goes back to DIST_UNREACHABLE.       */
+template <character_type_t ct>
+static void dial_pathfind(map_t *m, uint16_t dist[MAP_Y][MAP_X],
+                          const pair_t from, const pair_t seed)
+{
+  static int16_t next[MAP_Y * MAP_X], prev[MAP_Y * MAP_X];
+  static uint8_t state[MAP_Y * MAP_X];
+  const uint8_t *cost = &m->path_cost[ct][0][0];
+  uint16_t *du = &dist[0][0];
+  int16_t bucket[DIAL_BUCKETS];
+  int i, u, v, b, d, cur, queued;
+
+  u = from[dim_y] * MAP_X + from[dim_x];
+
+  /* Only passable cells ever take part, the PC's included.  An *
+   * unreachable cell keeps DIST_UNREACHABLE.                    */
+  if (cost[u] == PATH_IMPASSABLE) {
+    seed = NULL;
+    d = DIST_UNREACHABLE;
+  } else {
+    d = cost[u];
+  }
+
+  for (v = 0; v < MAP_Y * MAP_X; v++) {
+    if (!seed || du[v] == DIST_UNREACHABLE) {
+      du[v] = DIST_UNREACHABLE;
+    } else {
+      du[v] = du[v] + d > DIST_MAX ? DIST_MAX : du[v] + d;
     }
-    if ((p[c->pos[dim_y]    ][c->pos[dim_x] - 1].hn) &&
-        (world.hiker_dist[c->pos[dim_y]    ][c->pos[dim_x] - 1] >
-         world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker))) {
-      world.hiker_dist[c->pos[dim_y]    ][c->pos[dim_x] - 1] =
-        world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y]    ][c->pos[dim_x] - 1].hn);
+  }
+  if (seed) {
+    v = seed[dim_y] * MAP_X + seed[dim_x];
+    if (cost[v] == PATH_IMPASSABLE) {
+      du[v] = DIST_UNREACHABLE;
     }
-    if ((p[c->pos[dim_y]    ][c->pos[dim_x] + 1].hn) &&
-        (world.hiker_dist[c->pos[dim_y]    ][c->pos[dim_x] + 1] >
-         world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker))) {
-      world.hiker_dist[c->pos[dim_y]    ][c->pos[dim_x] + 1] =
-        world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y]    ][c->pos[dim_x] + 1].hn);
+  }
+  memset(state, dial_unseen, sizeof (state));
+  for (i = 0; i < DIAL_BUCKETS; i++) {
+    bucket[i] = DIAL_NONE;
+  }
+
+  du[u] = 0;
+
+  if (d == DIST_UNREACHABLE) {
+    return;
+  }
+
+  next[u] = prev[u] = DIAL_NONE;
+  bucket[0] = u;
+  state[u] = dial_queued;
+
+  for (cur = 0, queued = 1; queued; ) {
+    while (bucket[cur % DIAL_BUCKETS] == DIAL_NONE) {
+      cur++;
     }
-    if ((p[c->pos[dim_y] + 1][c->pos[dim_x] - 1].hn) &&
-        (world.hiker_dist[c->pos[dim_y] + 1][c->pos[dim_x] - 1] >
-         world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker))) {
-      world.hiker_dist[c->pos[dim_y] + 1][c->pos[dim_x] - 1] =
-        world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] + 1][c->pos[dim_x] - 1].hn);
+
+    u = bucket[cur % DIAL_BUCKETS];
+    if ((bucket[cur % DIAL_BUCKETS] = next[u]) != DIAL_NONE) {
+      prev[next[u]] = DIAL_NONE;
     }
-    if ((p[c->pos[dim_y] + 1][c->pos[dim_x]    ].hn) &&
-        (world.hiker_dist[c->pos[dim_y] + 1][c->pos[dim_x]    ] >
-         world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker))) {
-      world.hiker_dist[c->pos[dim_y] + 1][c->pos[dim_x]    ] =
-        world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] + 1][c->pos[dim_x]    ].hn);
+    state[u] = dial_done;
+    queued--;
+
+    if ((d = du[u] + cost[u]) > DIST_MAX) {
+      d = DIST_MAX;
     }
-    if ((p[c->pos[dim_y] + 1][c->pos[dim_x] + 1].hn) &&
-        (world.hiker_dist[c->pos[dim_y] + 1][c->pos[dim_x] + 1] >
-         world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker))) {
-      world.hiker_dist[c->pos[dim_y] + 1][c->pos[dim_x] + 1] =
-        world.hiker_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_hiker);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] + 1][c->pos[dim_x] + 1].hn);
+
+    for (i = 0; i < 8; i++) {
+      v = u + flat_dirs[i];
+      if (state[v] == dial_done || cost[v] == PATH_IMPASSABLE ||
+          du[v] <= d) {
+        continue;
+      }
+
+      if (state[v] == dial_queued) {
+        if (prev[v] == DIAL_NONE) {
+          bucket[du[v] % DIAL_BUCKETS] = next[v];
+        } else {
+          next[prev[v]] = next[v];
+        }
+        if (next[v] != DIAL_NONE) {
+          prev[next[v]] = prev[v];
+        }
+      } else {
+        state[v] = dial_queued;
+        queued++;
+      }
+
+      du[v] = d;
+      b = d % DIAL_BUCKETS;
+      prev[v] = DIAL_NONE;
+      if ((next[v] = bucket[b]) != DIAL_NONE) {
+        prev[next[v]] = v;
+      }
+      bucket[b] = v;
     }
   }
-  heap_delete(&h);
+}
 
-  heap_init(&h, rival_cmp, NULL);
+/* Bit i of a cell's flow is set if all_dirs[i] leads to one of its   *
+ * nearest neighbours in dist.  A cell gets no flow at all, leaving the *
+ * movers to scan, if every neighbour is unreachable or if one of them *
+ * is the source, where the movers start a battle instead.  Cells ct   *
+ * can't stand on are skipped; no ct chaser is ever there to ask.      */
+template <character_type_t ct>
+static void flow_field(map_t *m, uint16_t dist[MAP_Y][MAP_X],
+                       uint8_t flow[MAP_Y][MAP_X], const pair_t from)
+{
+  const uint8_t *cost = &m->path_cost[ct][0][0];
+  const uint16_t *du = &dist[0][0];
+  int x, y, i, u, d, min;
+  uint8_t f;
 
+  memset(flow, 0, MAP_Y * MAP_X);
   for (y = 1; y < MAP_Y - 1; y++) {
     for (x = 1; x < MAP_X - 1; x++) {
-      if (ter_cost(x, y, char_rival) != INT_MAX) {
-        p[y][x].hn = heap_insert(&h, &p[y][x]);
-      } else {
-        p[y][x].hn = NULL;
+      u = y * MAP_X + x;
+      if (cost[u] == PATH_IMPASSABLE) {
+        continue;
       }
+      for (min = DIST_UNREACHABLE, f = 0, i = 0; i < 8; i++) {
+        if ((d = du[u + flat_dirs[i]]) < min) {
+          min = d;
+          f = 1 << i;
+        } else if (d == min) {
+          f |= 1 << i;
+        }
+      }
+      flow[y][x] = min == DIST_UNREACHABLE ? 0 : f;
     }
   }
 
-  while ((c = (path_t *) heap_remove_min(&h))) {
-    c->hn = NULL;
-    if ((p[c->pos[dim_y] - 1][c->pos[dim_x] - 1].hn) &&
-        (world.rival_dist[c->pos[dim_y] - 1][c->pos[dim_x] - 1] >
-         world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival))) {
-      world.rival_dist[c->pos[dim_y] - 1][c->pos[dim_x] - 1] =
-        world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] - 1][c->pos[dim_x] - 1].hn);
-    }
-    if ((p[c->pos[dim_y] - 1][c->pos[dim_x]    ].hn) &&
-        (world.rival_dist[c->pos[dim_y] - 1][c->pos[dim_x]    ] >
-         world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival))) {
-      world.rival_dist[c->pos[dim_y] - 1][c->pos[dim_x]    ] =
-        world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] - 1][c->pos[dim_x]    ].hn);
-    }
-    if ((p[c->pos[dim_y] - 1][c->pos[dim_x] + 1].hn) &&
-        (world.rival_dist[c->pos[dim_y] - 1][c->pos[dim_x] + 1] >
-         world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival))) {
-      world.rival_dist[c->pos[dim_y] - 1][c->pos[dim_x] + 1] =
-        world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] - 1][c->pos[dim_x] + 1].hn);
-    }
-    if ((p[c->pos[dim_y]    ][c->pos[dim_x] - 1].hn) &&
-        (world.rival_dist[c->pos[dim_y]    ][c->pos[dim_x] - 1] >
-         world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival))) {
-      world.rival_dist[c->pos[dim_y]    ][c->pos[dim_x] - 1] =
-        world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y]    ][c->pos[dim_x] - 1].hn);
-    }
-    if ((p[c->pos[dim_y]    ][c->pos[dim_x] + 1].hn) &&
-        (world.rival_dist[c->pos[dim_y]    ][c->pos[dim_x] + 1] >
-         world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival))) {
-      world.rival_dist[c->pos[dim_y]    ][c->pos[dim_x] + 1] =
-        world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y]    ][c->pos[dim_x] + 1].hn);
-    }
-    if ((p[c->pos[dim_y] + 1][c->pos[dim_x] - 1].hn) &&
-        (world.rival_dist[c->pos[dim_y] + 1][c->pos[dim_x] - 1] >
-         world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival))) {
-      world.rival_dist[c->pos[dim_y] + 1][c->pos[dim_x] - 1] =
-        world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] + 1][c->pos[dim_x] - 1].hn);
-    }
-    if ((p[c->pos[dim_y] + 1][c->pos[dim_x]    ].hn) &&
-        (world.rival_dist[c->pos[dim_y] + 1][c->pos[dim_x]    ] >
-         world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival))) {
-      world.rival_dist[c->pos[dim_y] + 1][c->pos[dim_x]    ] =
-        world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] + 1][c->pos[dim_x]    ].hn);
-    }
-    if ((p[c->pos[dim_y] + 1][c->pos[dim_x] + 1].hn) &&
-        (world.rival_dist[c->pos[dim_y] + 1][c->pos[dim_x] + 1] >
-         world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-         ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival))) {
-      world.rival_dist[c->pos[dim_y] + 1][c->pos[dim_x] + 1] =
-        world.rival_dist[c->pos[dim_y]][c->pos[dim_x]] +
-        ter_cost(c->pos[dim_x], c->pos[dim_y], char_rival);
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] + 1][c->pos[dim_x] + 1].hn);
+  for (i = 0; i < 8; i++) {
+    x = from[dim_x] + all_dirs[i][dim_x];
+    y = from[dim_y] + all_dirs[i][dim_y];
+    if (x >= 0 && x < MAP_X && y >= 0 && y < MAP_Y) {
+      flow[y][x] = 0;
     }
   }
-  heap_delete(&h);
+}
+
+/* The distance maps are only as current as the last pathfind_update(). *
+ * Whatever moves the PC or changes the map calls pathfind_dirty(), which *
+ * just records where the maps should be measured from; anything about   *
+ * to read world.hiker_dist or world.rival_dist calls pathfind_update()  *
+ * first.  So PC turns with no hiker or rival moving before the next one *
+ * cost nothing, and neither do maps whose chasers are all defeated.     *
+ *                                                                        *
+ * When the maps are brought up to date the PC has usually not moved, or *
+ * moved a single step, from where they were last measured.  The first   *
+ * needs no work at all and the second only a repair of the maps already *
+ * in world.  Build with -DDEBUG_PATHFIND to check each result against a *
+ * search from scratch.                                                  */
+static struct {
+  map_t *map;
+  pair_t pos;
+} pathfind_from, pathfind_want;
+
+static struct {
+  uint32_t dirty, full, repaired;
+} pathfind_count;
+
+void pathfind_dirty(map_t *m)
+{
+  pathfind_want.map = m;
+  pathfind_want.pos[dim_x] = world.pc.pos[dim_x];
+  pathfind_want.pos[dim_y] = world.pc.pos[dim_y];
+  pathfind_count.dirty++;
+}
+
+/* Forgets the maps measured from, so nothing is reused or repaired from *
+ * a world that delete_world() has freed, even if a new map lands at the *
+ * same address.                                                         */
+void pathfind_reset()
+{
+  memset(&pathfind_from, 0, sizeof (pathfind_from));
+  memset(&pathfind_want, 0, sizeof (pathfind_want));
+}
+
+void pathfind_update()
+{
+  map_t *m;
+  int dx, dy;
+  bool seeded;
+
+  m = pathfind_want.map;
+  dx = pathfind_want.pos[dim_x] - pathfind_from.pos[dim_x];
+  dy = pathfind_want.pos[dim_y] - pathfind_from.pos[dim_y];
+  if (!m || (m == pathfind_from.map && !dx && !dy)) {
+    return;
+  }
+  /* Only the calls that do some work */
+  PROF_SCOPE(prof_pathfind);
+  TRACE_SCOPE("pathfind_update", "path");
+  seeded = (m == pathfind_from.map &&
+            dx >= -1 && dx <= 1 && dy >= -1 && dy <= 1);
+
+  dial_pathfind<char_hiker>(m, world.hiker_dist, pathfind_want.pos,
+                            seeded ? pathfind_from.pos : NULL);
+  dial_pathfind<char_rival>(m, world.rival_dist, pathfind_want.pos,
+                            seeded ? pathfind_from.pos : NULL);
+  flow_field<char_hiker>(m, world.hiker_dist, world.hiker_flow,
+                         pathfind_want.pos);
+  flow_field<char_rival>(m, world.rival_dist, world.rival_flow,
+                         pathfind_want.pos);
+
+  pathfind_from = pathfind_want;
+  if (seeded) {
+    pathfind_count.repaired++;
+  } else {
+    pathfind_count.full++;
+  }
+
+#ifdef DEBUG_PATHFIND
+  static uint16_t hiker[MAP_Y][MAP_X], rival[MAP_Y][MAP_X];
+
+  dial_pathfind<char_hiker>(m, hiker, pathfind_want.pos, NULL);
+  dial_pathfind<char_rival>(m, rival, pathfind_want.pos, NULL);
+  if (memcmp(hiker, world.hiker_dist, sizeof (hiker)) ||
+      memcmp(rival, world.rival_dist, sizeof (rival))) {
+    fprintf(stderr, "pathfind: %s repair from (%d,%d) differs from a full "
+            "search\n", seeded ? "seeded" : "full",
+            pathfind_want.pos[dim_x], pathfind_want.pos[dim_y]);
+    abort();
+  }
+#endif
+}
+
+void pathfind(map_t *m)
+{
+  pathfind_dirty(m);
+  pathfind_update();
+}
+
+void pathfind_print_stats(FILE *f)
+{
+  uint32_t built;
+
+  built = pathfind_count.full + pathfind_count.repaired;
+  fprintf(f, "Distance maps: %u requested, %u brought up to date "
+          "(%u full, %u repaired), %u avoided\n", pathfind_count.dirty,
+          built, pathfind_count.full, pathfind_count.repaired,
+          pathfind_count.dirty - built);
 }
@@ -0,0 +1,257 @@
+#include <cstring>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+# include <immintrin.h>
+#endif
+
+#include "csv.h"
+
+/* Delimiters are found a block at a time: one compare per delimiter     *
+ * gives a bitmask with a bit set for every ',' and '\n' in the block, and *
+ * fields are then handed out by peeling bits off that mask.  With AVX2 a  *
+ * block is 32 bytes, with SSE2 16; without either the mask is built a     *
+ * byte at a time, which is no worse than the old strtok-style loop.       */
+#if defined(__AVX2__)
+# define CSV_BLOCK 32
+
+static inline uint32_t block_mask(const char *p)
+{
+  __m256i v = _mm256_loadu_si256((const __m256i *) p);
+
+  return _mm256_movemask_epi8(
+           _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(',')),
+                           _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))));
+}
+
+static inline uint32_t newline_mask(const char *p)
+{
+  __m256i v = _mm256_loadu_si256((const __m256i *) p);
+
+  return _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+}
+#elif defined(__SSE2__)
+# define CSV_BLOCK 16
+
+static inline uint32_t block_mask(const char *p)
+{
+  __m128i v = _mm_loadu_si128((const __m128i *) p);
+
+  return _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(',')),
+                                        _mm_cmpeq_epi8(v,
+                                                       _mm_set1_epi8('\n'))));
+}
+
+static inline uint32_t newline_mask(const char *p)
+{
+  __m128i v = _mm_loadu_si128((const __m128i *) p);
+
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+}
+#else
+# define CSV_BLOCK 32
+
+static inline uint32_t block_mask(const char *p)
+{
+  uint32_t m;
+  int i;
+
+  for (m = 0, i = 0; i < CSV_BLOCK; i++) {
+    m |= (uint32_t) (p[i] == ',' || p[i] == '\n') << i;
+  }
+
+  return m;
+}
+
+static inline uint32_t newline_mask(const char *p)
+{
+  uint32_t m;
+  int i;
+
+  for (m = 0, i = 0; i < CSV_BLOCK; i++) {
+    m |= (uint32_t) (p[i] == '\n') << i;
+  }
+
+  return m;
+}
+#endif
+
+/* The last partial block can't be loaded whole without reading past the *
+ * end of the mapping, so it is always done a byte at a time.            */
+static uint32_t tail_mask(const char *p, const char *end)
+{
+  uint32_t m;
+  int i;
+
+  for (m = 0, i = 0; p + i < end; i++) {
+    m |= (uint32_t) (p[i] == ',' || p[i] == '\n') << i;
+  }
+
+  return m;
+}
+
+static inline uint32_t load_mask(const char *p, const char *end)
+{
+  if (p + CSV_BLOCK <= end) {
+    return block_mask(p);
+  }
+
+  return p < end ? tail_mask(p, end) : 0;
+}
+
+/* Returns the next ',' or '\n' at or after r->pos, or r->end if none. */
+static inline const char *next_delim(csv_t *r)
+{
+  const char *d;
+
+  while (!r->mask) {
+    if ((r->block += CSV_BLOCK) >= r->end) {
+      r->block = r->end;
+      return r->end;
+    }
+    r->mask = load_mask(r->block, r->end);
+  }
+
+  d = r->block + __builtin_ctz(r->mask);
+  r->mask &= r->mask - 1;
+
+  return d;
+}
+
+int csv_map(csv_file_t *f, const char *path)
+{
+  struct stat buf;
+  void *p;
+  int fd;
+
+  if ((fd = open(path, O_RDONLY)) < 0) {
+    return 1;
+  }
+
+  if (fstat(fd, &buf)) {
+    close(fd);
+    return 1;
+  }
+
+  f->size = buf.st_size;
+  if (!f->size) {
+    /* mmap() refuses zero lengths; an empty file is just no rows */
+    f->data = NULL;
+    close(fd);
+    return 0;
+  }
+
+  p = mmap(NULL, f->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (p == MAP_FAILED) {
+    return 1;
+  }
+  madvise(p, f->size, MADV_SEQUENTIAL);
+  f->data = (const char *) p;
+
+  return 0;
+}
+
+void csv_unmap(csv_file_t *f)
+{
+  if (f->data) {
+    munmap((void *) f->data, f->size);
+  }
+  f->data = NULL;
+  f->size = 0;
+}
+
+void csv_init(csv_t *r, const char *start, const char *end)
+{
+  r->pos = start;
+  r->end = end;
+  r->block = start;
+  r->mask = load_mask(start, end);
+}
+
+int csv_row(csv_t *r, csv_field_t *field, int max)
+{
+  const char *d;
+  int n, i;
+
+  if (r->pos >= r->end) {
+    for (n = 0; n < max; n++) {
+      field[n].s = r->end;
+      field[n].len = 0;
+    }
+    return -1;
+  }
+
+  for (n = 0; ; n++) {
+    d = next_delim(r);
+    if (n < max) {
+      field[n].s = r->pos;
+      field[n].len = d - r->pos;
+    }
+    if (d == r->end) {
+      r->pos = r->end;
+      break;
+    }
+    r->pos = d + 1;
+    if (*d == '\n') {
+      break;
+    }
+  }
+
+  for (i = ++n; i < max; i++) {
+    field[i].s = r->pos;
+    field[i].len = 0;
+  }
+
+  return n;
+}
+
+int csv_count_lines(const char *start, const char *end)
+{
+  const char *p;
+  int n;
+
+  for (n = 0, p = start; p + CSV_BLOCK <= end; p += CSV_BLOCK) {
+    n += __builtin_popcount(newline_mask(p));
+  }
+  for (; p < end; p++) {
+    n += *p == '\n';
+  }
+
+  return n;
+}
+
+int csv_int(csv_field_t f)
+{
+  const char *s, *e;
+  int v, neg;
+
+  if (!f.len) {
+    return INT_MAX;
+  }
+
+  s = f.s;
+  e = s + f.len;
+  if ((neg = (*s == '-'))) {
+    s++;
+  }
+  for (v = 0; s < e && *s >= '0' && *s <= '9'; s++) {
+    v = v * 10 + (*s - '0');
+  }
+
+  return neg ? -v : v;
+}
+
+void csv_str(char *dst, size_t size, csv_field_t f)
+{
+  size_t n;
+
+  n = (size_t) f.len < size ? f.len : size - 1;
+  memcpy(dst, f.s, n);
+  dst[n] = '\0';
+}
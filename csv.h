@@ -0,0 +1,50 @@
+#ifndef CSV_H
+# define CSV_H
+
+# include <stddef.h>
+# include <stdint.h>
+
+/* A field is a view into the mapped file, not a copy, and it is not NUL *
+ * terminated.  Use csv_int() or csv_str() to get at the value.          */
+typedef struct csv_field {
+  const char *s;
+  int len;
+} csv_field_t;
+
+/* A whole file mapped read-only.  Unmap it only after every field taken *
+ * from it is dead.                                                       */
+typedef struct csv_file {
+  const char *data;
+  size_t size;
+} csv_file_t;
+
+/* Walks the rows of [pos, end), which must start at the beginning of a  *
+ * line.  Several readers may share one file as long as their ranges do  *
+ * not overlap.                                                          */
+typedef struct csv {
+  const char *pos;
+  const char *end;
+  const char *block;  /* Start of the block the bits of mask refer to */
+  uint32_t mask;      /* Delimiters in block not yet handed out       */
+} csv_t;
+
+int csv_map(csv_file_t *f, const char *path);
+void csv_unmap(csv_file_t *f);
+
+void csv_init(csv_t *r, const char *start, const char *end);
+/* Fills in up to max fields of the next row and returns how many fields *
+ * the row had, or -1 at the end.  Fields the row is missing come back   *
+ * empty, so a short row reads as a row of empty fields.                 */
+int csv_row(csv_t *r, csv_field_t *field, int max);
+/* Number of newlines in [start, end). */
+int csv_count_lines(const char *start, const char *end);
+
+/* Decimal integer, or INT_MAX for an empty field, the same convention  *
+ * the tables use everywhere.  Like atoi(), stops at the first non-digit *
+ * but never looks at the locale.                                        */
+int csv_int(csv_field_t f);
+
+/* Copies the field into dst, truncating to fit, always NUL terminated. */
+void csv_str(char *dst, size_t size, csv_field_t f);
+
+#endif
@@ -3,27 +3,16 @@
 #include <cstdlib>
 #include <sys/stat.h>
 #include <climits>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <time.h>
 
 #include "db_parse.h"
-
-static char *next_token(char *start, char delim)
-{
-  int i;
-  static char *s;
-
-  if (start) {
-    s = start;
-  }
-
-  start = s;
-
-  for (i = 0; s[i] && s[i] != delim; i++)
-    ;
-  s[i] = '\0';
-  s = s + i + 1;
-
-  return start;
-}
+#include "db_snapshot.h"
+#include "csv.h"
+#include "trace.h"
 
 /* We can't print a "null integer", so it takes an annoying amount of code *
  * to check for INT_MAX and then print "", otherwise print the integer     *
@@ -52,467 +41,788 @@ const char *i2s(int i)
   return s[next++];
 }
 
-pokemon_move_db pokemon_moves[528239];
-pokemon_db pokemon[1093];
-char *types[19];
-move_db moves[845];
-pokemon_species_db species[899];
-experience_db experience[601];
-pokemon_stats_db pokemon_stats[6553];
-stats_db stats[9];
-pokemon_types_db pokemon_types[1676];
+/* With POKEDEX_STATIC the tables are compiled in: pokedex_data.cpp, *
+ * generated by pokedex_gen, defines all of these instead.           */
+#ifndef POKEDEX_STATIC
+const pokemon_move_db *pokemon_moves;
+int num_pokemon_moves;
+const pokemon_db *pokemon;
+const char *types[NUM_TYPES];
+const move_db *moves;
+const pokemon_species_db *species;
+const experience_db *experience;
+const pokemon_stats_db *pokemon_stats;
+const stats_db *stats;
+const pokemon_types_db *pokemon_types;
+
+const int *learnset_offset;
+const int *move_index;
+int num_move_ids;
+const int (*species_base_stats)[6];
+#else
+extern const uint32_t pokedex_version_groups;
+extern const uint32_t pokedex_move_methods;
+#endif
+
+uint32_t db_version_groups = DB_ALL;
+uint32_t db_move_methods = 1 << 1; /* level-up */
+
+int db_load_threads = 0;
+
+static int keep_id(uint32_t mask, int id)
+{
+  return mask == DB_ALL || (id >= 0 && id < 32 && (mask & (1u << id)));
+}
 
-void db_parse(bool print)
+static uint16_t pack16(int i)
+{
+  return i == INT_MAX ? DB_NONE16 : i;
+}
+
+static int unpack16(uint16_t i)
+{
+  return i == DB_NONE16 ? INT_MAX : i;
+}
+
+static bool learnset_order(const pokemon_move_db &a, const pokemon_move_db &b)
+{
+  return (a.pokemon_id < b.pokemon_id ||
+          (a.pokemon_id == b.pokemon_id && a.level < b.level));
+}
+
+/* Only pokedex_gen tolerates missing files; see db_parse_csv(). */
+static bool csv_missing_ok;
+
+/* Maps prefix/name; the caller unmaps it once the table is parsed. */
+static void csv_open(const char *prefix, const char *name, csv_file_t *f)
+{
+  char *path;
+
+  path = (char *) malloc(strlen(prefix) + strlen(name) + 1);
+  strcpy(path, prefix);
+  strcat(path, name);
+
+  //Still no real error checking, but fail loudly rather than segfault.
+  if (csv_map(f, path)) {
+    if (!csv_missing_ok) {
+      fprintf(stderr, "Failed to open %s\n", path);
+      exit(1);
+    }
+    fprintf(stderr, "Warning: %s is missing; its table will be empty\n", path);
+    f->data = NULL;
+    f->size = 0;
+  }
+  free(path);
+}
+
+static double now_ms()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/* Dumps every table back out as CSV in the working directory, in the *
+ * same format it was read in.  Empty fields print as empty strings.   */
+static void db_print()
 {
   FILE *f;
-  char line[800];
   int i;
-  char *tmp;
-  struct stat buf;
-  char *prefix;
-  int prefix_len;
-  int j;
-  int count;
-  
-  i = (strlen(getenv("HOME")) +
-       strlen("/.poke327/pokedex/pokedex/data/csv/") + 1);
-  prefix = (char *) malloc(i);
-  strcpy(prefix, getenv("HOME"));
-  strcat(prefix, "/.poke327/pokedex/pokedex/data/csv/");
 
-  if (stat(prefix, &buf)) {
-    free(prefix);
-    prefix = NULL;
+  f = fopen("pokemon.csv", "w");
+  for (i = 1; i < NUM_POKEMON; i++) {
+    fprintf(f, "%s,%s,%s,%s,%s,%s,%s,%s\n",
+            i2s(pokemon[i].id),
+            pokemon[i].identifier,
+            i2s(pokemon[i].species_id),
+            i2s(pokemon[i].height),
+            i2s(pokemon[i].weight),
+            i2s(pokemon[i].base_experience),
+            i2s(pokemon[i].order),
+            i2s(pokemon[i].is_default));
   }
+  fclose(f);
 
-  if (!prefix && !stat("/share/cs327", &buf)) {
-    prefix = strdup("/share/cs327/pokedex/pokedex/data/csv/");
-  } else if (!prefix) {
-    // Your third location goes here, if needed.
-    // prefix is freed later, so be sure you malloc it
-    i = (strlen("../csv/") + 1);
-    prefix = (char *) malloc(i);
-    prefix = strdup("../csv/");
+  f = fopen("moves.csv", "w");
+  for (i = 1; i < NUM_MOVES; i++) {
+    fprintf(f, "%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s\n",
+            i2s(moves[i].id),
+            moves[i].identifier,
+            i2s(moves[i].generation_id),
+            i2s(moves[i].type_id),
+            i2s(moves[i].power),
+            i2s(moves[i].pp),
+            i2s(moves[i].accuracy),
+            i2s(moves[i].priority),
+            i2s(moves[i].target_id),
+            i2s(moves[i].damage_class_id),
+            i2s(moves[i].effect_id),
+            i2s(moves[i].effect_chance),
+            i2s(moves[i].contest_type_id),
+            i2s(moves[i].contest_effect_id),
+            i2s(moves[i].super_contest_effect_id));
   }
+  fclose(f);
 
-  //No error checking on file load from here on out.  Missing
-  //files are "user error".
-  prefix_len = strlen(prefix);
-
-  prefix = (char *) realloc(prefix, prefix_len + strlen("pokemon.csv") + 1);
-  strcpy(prefix + prefix_len, "pokemon.csv");
-  
-  f = fopen(prefix, "r");
+  f = fopen("pokemon_moves.csv", "w");
+  for (i = 0; i < num_pokemon_moves; i++) {
+    fprintf(f, "%s,%s,%s,%s,%s,%s\n",
+            i2s(unpack16(pokemon_moves[i].pokemon_id)),
+            i2s(unpack16(pokemon_moves[i].version_group_id)),
+            i2s(unpack16(pokemon_moves[i].move_id)),
+            i2s(unpack16(pokemon_moves[i].pokemon_move_method_id)),
+            i2s(unpack16(pokemon_moves[i].level)),
+            i2s(unpack16(pokemon_moves[i].order)));
+  }
+  fclose(f);
 
-  //No null byte copied here, so prefix is not technically a string anymore.
-  prefix = (char *) realloc(prefix, prefix_len + 1);
+  f = fopen("pokemon_species.csv", "w");
+  for (i = 1; i < NUM_SPECIES; i++) {
+    fprintf(f,
+            "%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s\n",
+            i2s(species[i].id),
+            species[i].identifier,
+            i2s(species[i].generation_id),
+            i2s(species[i].evolves_from_species_id),
+            i2s(species[i].evolution_chain_id),
+            i2s(species[i].color_id),
+            i2s(species[i].shape_id),
+            i2s(species[i].habitat_id),
+            i2s(species[i].gender_rate),
+            i2s(species[i].capture_rate),
+            i2s(species[i].base_happiness),
+            i2s(species[i].is_baby),
+            i2s(species[i].hatch_counter),
+            i2s(species[i].has_gender_differences),
+            i2s(species[i].growth_rate_id),
+            i2s(species[i].forms_switchable),
+            i2s(species[i].is_legendary),
+            i2s(species[i].is_mythical),
+            i2s(species[i].order),
+            i2s(species[i].conquest_order));
+  }
+  fclose(f);
 
-  fgets(line, 80, f);
-  
-  for (i = 1; i < 1093; i++) {
-    fgets(line, 80, f);
-    pokemon[i].id = atoi(next_token(line, ','));
-    strncpy(pokemon[i].identifier, next_token(NULL, ','), 30);
-    pokemon[i].species_id = atoi(next_token(NULL, ','));
-    pokemon[i].height = atoi(next_token(NULL, ','));
-    pokemon[i].weight = atoi(next_token(NULL, ','));
-    pokemon[i].base_experience = atoi(next_token(NULL, ','));
-    pokemon[i].order = atoi(next_token(NULL, ','));
-    pokemon[i].is_default = atoi(next_token(NULL, ','));
-  }  
+  f = fopen("experience.csv", "w");
+  for (i = 1; i < NUM_EXPERIENCE; i++) {
+    fprintf(f, "%s,%s,%s\n",
+            i2s(experience[i].growth_rate_id),
+            i2s(experience[i].level),
+            i2s(experience[i].experience));
+  }
+  fclose(f);
 
+  f = fopen("type_names.csv", "w");
+  for (i = 1; i < NUM_TYPES; i++) {
+    fprintf(f, "%s\n", types[i]);
+  }
   fclose(f);
-  
-  if (print) {
-    f = fopen("pokemon.csv", "w");
-    for (i = 1; i < 1093; i++) {
-      fprintf(f, "%s,%s,%s,%s,%s,%s,%s,%s\n",
-              i2s(pokemon[i].id),
-              pokemon[i].identifier,
-              i2s(pokemon[i].species_id),
-              i2s(pokemon[i].height),
-              i2s(pokemon[i].weight),
-              i2s(pokemon[i].base_experience),
-              i2s(pokemon[i].order),
-              i2s(pokemon[i].is_default));
-    }
-    fclose(f);
+
+  f = fopen("pokemon_stats.csv", "w");
+  for (i = 1; i < NUM_POKEMON_STATS; i++) {
+    fprintf(f, "%s,%s,%s,%s\n",
+            i2s(pokemon_stats[i].pokemon_id),
+            i2s(pokemon_stats[i].stat_id),
+            i2s(pokemon_stats[i].base_stat),
+            i2s(pokemon_stats[i].effort));
   }
+  fclose(f);
 
+  f = fopen("stats.csv", "w");
+  for (i = 1; i < NUM_STATS; i++) {
+    fprintf(f, "%s,%s,%s,%s,%s\n",
+            i2s(stats[i].id),
+            i2s(stats[i].damage_class_id),
+            stats[i].identifier,
+            i2s(stats[i].is_battle_only),
+            i2s(stats[i].game_index));
+  }
+  fclose(f);
 
-  prefix = (char *) realloc(prefix, prefix_len + strlen("moves.csv") + 1);
-  strcpy(prefix + prefix_len, "moves.csv");
-  
-  f = fopen(prefix, "r");
+  f = fopen("pokemon_types.csv", "w");
+  for (i = 1; i < NUM_POKEMON_TYPES; i++) {
+    fprintf(f, "%s,%s,%s\n",
+            i2s(pokemon_types[i].pokemon_id),
+            i2s(pokemon_types[i].type_id),
+            i2s(pokemon_types[i].slot));
+  }
+  fclose(f);
+}
 
-  //No null byte copied here, so prefix is not technically a string anymore.
-  prefix = (char *) realloc(prefix, prefix_len + 1);
+void db_build_index()
+{
+  int *offset, *index;
+  int (*base)[6];
+  int i, j, max;
+  TRACE_SCOPE("db_build_index", "db");
+
+  /* pokemon_moves is already sorted by species, so the learnset index is *
+   * just the start of each species' run.  Rows for alternate forms      *
+   * (pokemon ids past the species range) sort last and are not indexed. */
+  offset = (int *) malloc((NUM_SPECIES + 1) * sizeof (*offset));
+  for (i = j = 0; i <= NUM_SPECIES; i++) {
+    while (j < num_pokemon_moves && pokemon_moves[j].pokemon_id < i) {
+      j++;
+    }
+    offset[i] = j;
+  }
 
-  fgets(line, 800, f);
-  
-  for (i = 1; i < 845; i++) {
-    fgets(line, 800, f);
-    moves[i].id = atoi((tmp = next_token(line, ',')));
-    strcpy(moves[i].identifier, (tmp = next_token(NULL, ',')));
-    tmp = next_token(NULL, ',');
-    moves[i].generation_id = *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    moves[i].type_id =  *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    moves[i].power =  *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    moves[i].pp =  *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    moves[i].accuracy =  *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    moves[i].priority =  *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    moves[i].target_id =  *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    moves[i].damage_class_id =  *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    moves[i].effect_id =  *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    moves[i].effect_chance =  *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    moves[i].contest_type_id =  *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    moves[i].contest_effect_id =  *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    moves[i].super_contest_effect_id = (*tmp != '\n') ? atoi(tmp) : INT_MAX;
+  for (max = 0, i = 1; i < NUM_MOVES; i++) {
+    if (moves[i].id > max) {
+      max = moves[i].id;
+    }
+  }
+  index = (int *) calloc(max + 1, sizeof (*index));
+  for (i = 1; i < NUM_MOVES; i++) {
+    index[moves[i].id] = i;
   }
 
-  fclose(f);
-  
-  if (print) {
-    f = fopen("moves.csv", "w");
-    for (i = 1; i < 845; i++) {
-      fprintf(f, "%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s\n",
-              i2s(moves[i].id),
-              moves[i].identifier,
-              i2s(moves[i].generation_id),
-              i2s(moves[i].type_id),
-              i2s(moves[i].power),
-              i2s(moves[i].pp),
-              i2s(moves[i].accuracy),
-              i2s(moves[i].priority),
-              i2s(moves[i].target_id),
-              i2s(moves[i].damage_class_id),
-              i2s(moves[i].effect_id),
-              i2s(moves[i].effect_chance),
-              i2s(moves[i].contest_type_id),
-              i2s(moves[i].contest_effect_id),
-              i2s(moves[i].super_contest_effect_id));
+  base = (int (*)[6]) malloc(NUM_SPECIES * sizeof (*base));
+  for (i = 0; i < NUM_SPECIES * 6; i++) {
+    base[i / 6][i % 6] = INT_MAX;
+  }
+  for (i = 1; i < NUM_POKEMON_STATS; i++) {
+    if (pokemon_stats[i].pokemon_id < NUM_SPECIES &&
+        pokemon_stats[i].stat_id >= 1 && pokemon_stats[i].stat_id <= 6) {
+      base[pokemon_stats[i].pokemon_id][pokemon_stats[i].stat_id - 1] =
+        pokemon_stats[i].base_stat;
     }
-    fclose(f);
   }
 
-  prefix = (char *) realloc(prefix,
-                            prefix_len + strlen("pokemon_moves.csv") + 1);
-  strcpy(prefix + prefix_len, "pokemon_moves.csv");
-  
-  f = fopen(prefix, "r");
+  learnset_offset = offset;
+  move_index = index;
+  num_move_ids = max + 1;
+  species_base_stats = base;
+}
 
-  //No null byte copied here, so prefix is not technically a string anymore.
-  prefix = (char *) realloc(prefix, prefix_len + 1);
+static void parse_pokemon(csv_t *f)
+{
+  csv_field_t field[8];
+  int i;
+  pokemon_db *pokemon;
 
-  fgets(line, 800, f);
-  
-  for (i = 1; i < 528239; i++) {
-    fgets(line, 800, f);
-    tmp = next_token(line, ',');
-    pokemon_moves[i].pokemon_id = *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    pokemon_moves[i].version_group_id = *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    pokemon_moves[i].move_id = *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    pokemon_moves[i].pokemon_move_method_id = *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    pokemon_moves[i].level = *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    pokemon_moves[i].order = (*tmp != '\n') ? atoi(tmp) : INT_MAX;
+  pokemon = (pokemon_db *) calloc(NUM_POKEMON, sizeof (*pokemon));
+
+  csv_row(f, field, 0);
+
+  for (i = 1; i < NUM_POKEMON && csv_row(f, field, 8) >= 0; i++) {
+    pokemon[i].id = csv_int(field[0]);
+    csv_str(pokemon[i].identifier, sizeof (pokemon[i].identifier), field[1]);
+    pokemon[i].species_id = csv_int(field[2]);
+    pokemon[i].height = csv_int(field[3]);
+    pokemon[i].weight = csv_int(field[4]);
+    pokemon[i].base_experience = csv_int(field[5]);
+    pokemon[i].order = csv_int(field[6]);
+    pokemon[i].is_default = csv_int(field[7]);
   }
 
-  fclose(f);
+  ::pokemon = pokemon;
+}
 
-  if (print) {
-    f = fopen("pokemon_moves.csv", "w");
-    for (i = 1; i < 528239; i++) {
-      fprintf(f, "%s,%s,%s,%s,%s,%s\n",
-              i2s(pokemon_moves[i].pokemon_id),
-              i2s(pokemon_moves[i].version_group_id),
-              i2s(pokemon_moves[i].move_id),
-              i2s(pokemon_moves[i].pokemon_move_method_id),
-              i2s(pokemon_moves[i].level),
-              i2s(pokemon_moves[i].order));
+static void parse_moves(csv_t *f)
+{
+  csv_field_t field[15];
+  int i;
+  move_db *moves;
+
+  moves = (move_db *) calloc(NUM_MOVES, sizeof (*moves));
+
+  csv_row(f, field, 0);
+
+  for (i = 1; i < NUM_MOVES && csv_row(f, field, 15) >= 0; i++) {
+    moves[i].id = csv_int(field[0]);
+    csv_str(moves[i].identifier, sizeof (moves[i].identifier), field[1]);
+    moves[i].generation_id = csv_int(field[2]);
+    moves[i].type_id = csv_int(field[3]);
+    moves[i].power = csv_int(field[4]);
+    moves[i].pp = csv_int(field[5]);
+    moves[i].accuracy = csv_int(field[6]);
+    moves[i].priority = csv_int(field[7]);
+    moves[i].target_id = csv_int(field[8]);
+    moves[i].damage_class_id = csv_int(field[9]);
+    moves[i].effect_id = csv_int(field[10]);
+    moves[i].effect_chance = csv_int(field[11]);
+    moves[i].contest_type_id = csv_int(field[12]);
+    moves[i].contest_effect_id = csv_int(field[13]);
+    moves[i].super_contest_effect_id = csv_int(field[14]);
+  }
+
+  ::moves = moves;
+}
+
+/* Parses one byte range of pokemon_moves.csv into out, keeping only the *
+ * rows that pass the filter, and returns how many were kept.             */
+static int parse_pokemon_moves(csv_t *f, pokemon_move_db *out)
+{
+  csv_field_t field[6];
+  int n;
+  int version_group_id, pokemon_move_method_id;
+
+  for (n = 0; csv_row(f, field, 6) >= 0; ) {
+    version_group_id = csv_int(field[1]);
+    pokemon_move_method_id = csv_int(field[3]);
+    if (keep_id(db_version_groups, version_group_id) &&
+        keep_id(db_move_methods, pokemon_move_method_id)) {
+      out[n].pokemon_id = pack16(csv_int(field[0]));
+      out[n].version_group_id = pack16(version_group_id);
+      out[n].move_id = pack16(csv_int(field[2]));
+      out[n].pokemon_move_method_id = pack16(pokemon_move_method_id);
+      out[n].level = pack16(csv_int(field[4]));
+      out[n].order = pack16(csv_int(field[5]));
+      n++;
     }
-    fclose(f);
   }
 
-  prefix = (char *) realloc(prefix,
-                            prefix_len + strlen("pokemon_species.csv") + 1);
-  strcpy(prefix + prefix_len, "pokemon_species.csv");
-  
-  f = fopen(prefix, "r");
+  return n;
+}
 
-  //No null byte copied here, so prefix is not technically a string anymore.
-  prefix = (char *) realloc(prefix, prefix_len + 1);
+static void parse_species(csv_t *f)
+{
+  csv_field_t field[20];
+  int i;
+  pokemon_species_db *species;
+
+  species = (pokemon_species_db *) calloc(NUM_SPECIES, sizeof (*species));
+
+  csv_row(f, field, 0);
+
+  for (i = 1; i < NUM_SPECIES && csv_row(f, field, 20) >= 0; i++) {
+    species[i].id = csv_int(field[0]);
+    csv_str(species[i].identifier, sizeof (species[i].identifier), field[1]);
+    species[i].generation_id = csv_int(field[2]);
+    species[i].evolves_from_species_id = csv_int(field[3]);
+    species[i].evolution_chain_id = csv_int(field[4]);
+    species[i].color_id = csv_int(field[5]);
+    species[i].shape_id = csv_int(field[6]);
+    species[i].habitat_id = csv_int(field[7]);
+    species[i].gender_rate = csv_int(field[8]);
+    species[i].capture_rate = csv_int(field[9]);
+    species[i].base_happiness = csv_int(field[10]);
+    species[i].is_baby = csv_int(field[11]);
+    species[i].hatch_counter = csv_int(field[12]);
+    species[i].has_gender_differences = csv_int(field[13]);
+    species[i].growth_rate_id = csv_int(field[14]);
+    species[i].forms_switchable = csv_int(field[15]);
+    species[i].is_legendary = csv_int(field[16]);
+    species[i].is_mythical = csv_int(field[17]);
+    species[i].order = csv_int(field[18]);
+    species[i].conquest_order = csv_int(field[19]);
+  }
 
-  fgets(line, 800, f);
-  
-  for (i = 1; i < 899; i++) {
-    fgets(line, 800, f);
-    species[i].id = atoi((tmp = next_token(line, ',')));
-    strcpy(species[i].identifier, (tmp = next_token(NULL, ',')));
-    tmp = next_token(NULL, ',');
-    species[i].generation_id = *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    species[i].evolves_from_species_id =  *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    species[i].evolution_chain_id =  *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    species[i].color_id =  *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    species[i].shape_id =  *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    species[i].habitat_id =  *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    species[i].gender_rate =  *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    species[i].capture_rate =  *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    species[i].base_happiness =  *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    species[i].is_baby =  *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    species[i].hatch_counter =  *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    species[i].has_gender_differences =  *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    species[i].growth_rate_id =  *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    species[i].forms_switchable =  *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    species[i].is_legendary =  *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    species[i].is_mythical =  *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    species[i].order =  *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    species[i].conquest_order = (*tmp != '\n') ? atoi(tmp) : INT_MAX;
+  ::species = species;
+}
+
+static void parse_experience(csv_t *f)
+{
+  csv_field_t field[3];
+  int i;
+  experience_db *experience;
+
+  experience = (experience_db *) calloc(NUM_EXPERIENCE, sizeof (*experience));
+
+  csv_row(f, field, 0);
+
+  for (i = 1; i < NUM_EXPERIENCE && csv_row(f, field, 3) >= 0; i++) {
+    experience[i].growth_rate_id = csv_int(field[0]);
+    experience[i].level = csv_int(field[1]);
+    experience[i].experience = csv_int(field[2]);
   }
 
-  fclose(f);
+  ::experience = experience;
+}
 
-  if (print) {
-    f = fopen("pokemon_species.csv", "w");
-    for (i = 1; i < 899; i++) {
-      fprintf(f,
-              "%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s\n",
-              i2s(species[i].id),
-              species[i].identifier,
-              i2s(species[i].generation_id),
-              i2s(species[i].evolves_from_species_id),
-              i2s(species[i].evolution_chain_id),
-              i2s(species[i].color_id),
-              i2s(species[i].shape_id),
-              i2s(species[i].habitat_id),
-              i2s(species[i].gender_rate),
-              i2s(species[i].capture_rate),
-              i2s(species[i].base_happiness),
-              i2s(species[i].is_baby),
-              i2s(species[i].hatch_counter),
-              i2s(species[i].has_gender_differences),
-              i2s(species[i].growth_rate_id),
-              i2s(species[i].forms_switchable),
-              i2s(species[i].is_legendary),
-              i2s(species[i].is_mythical),
-              i2s(species[i].order),
-              i2s(species[i].conquest_order));
-    }
-    fclose(f);
+static void parse_types(csv_t *f)
+{
+  csv_field_t field[3];
+  char *name;
+  int i;
+
+  csv_row(f, field, 0);
+
+  for (i = 1; i < NUM_TYPES && csv_row(f, field, 0) >= 0; i++) { //  1
+    csv_row(f, field, 0); //  3
+    csv_row(f, field, 0); //  4
+    csv_row(f, field, 0); //  5
+    csv_row(f, field, 0); //  6
+    csv_row(f, field, 0); //  7
+    csv_row(f, field, 0); //  8
+    csv_row(f, field, 3); //  9 - English
+    name = (char *) malloc(field[2].len + 1);
+    csv_str(name, field[2].len + 1, field[2]);
+    types[i] = name;
+    csv_row(f, field, 0); // 11
+    csv_row(f, field, 0); // 12
   }
+}
 
+static void parse_pokemon_stats(csv_t *f)
+{
+  csv_field_t field[4];
+  int i;
+  pokemon_stats_db *pokemon_stats;
 
-  prefix = (char *) realloc(prefix, prefix_len + strlen("experience.csv") + 1);
-  strcpy(prefix + prefix_len, "experience.csv");
-  
-  f = fopen(prefix, "r");
+  pokemon_stats = (pokemon_stats_db *) calloc(NUM_POKEMON_STATS,
+                                              sizeof (*pokemon_stats));
 
-  //No null byte copied here, so prefix is not technically a string anymore.
-  prefix = (char *) realloc(prefix, prefix_len + 1);
+  csv_row(f, field, 0);
 
-  fgets(line, 800, f);
-  
-  for (i = 1; i < 601; i++) {
-    fgets(line, 800, f);
-    experience[i].growth_rate_id = atoi((tmp = next_token(line, ',')));
-    tmp = next_token(NULL, ',');
-    experience[i].level = *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    experience[i].experience =  (*tmp != '\n') ? atoi(tmp) : INT_MAX;
+  for (i = 1; i < NUM_POKEMON_STATS && csv_row(f, field, 4) >= 0; i++) {
+    pokemon_stats[i].pokemon_id = csv_int(field[0]);
+    pokemon_stats[i].stat_id = csv_int(field[1]);
+    pokemon_stats[i].base_stat = csv_int(field[2]);
+    pokemon_stats[i].effort = csv_int(field[3]);
   }
 
-  fclose(f);
+  ::pokemon_stats = pokemon_stats;
+}
 
-  if (print) {
-    f = fopen("experience.csv", "w");
-    for (i = 1; i < 601; i++) {
-      fprintf(f, "%s,%s,%s\n",
-              i2s(experience[i].growth_rate_id),
-              i2s(experience[i].level),
-              i2s(experience[i].experience));
-    }
-    fclose(f);
+static void parse_stats(csv_t *f)
+{
+  csv_field_t field[5];
+  int i;
+  stats_db *stats;
+
+  stats = (stats_db *) calloc(NUM_STATS, sizeof (*stats));
+
+  csv_row(f, field, 0);
+
+  for (i = 1; i < NUM_STATS && csv_row(f, field, 5) >= 0; i++) {
+    stats[i].id = csv_int(field[0]);
+    stats[i].damage_class_id = csv_int(field[1]);
+    csv_str(stats[i].identifier, sizeof (stats[i].identifier), field[2]);
+    stats[i].is_battle_only = csv_int(field[3]);
+    stats[i].game_index = csv_int(field[4]);
   }
 
-  prefix = (char *) realloc(prefix, prefix_len + strlen("type_names.csv") + 1);
-  strcpy(prefix + prefix_len, "type_names.csv");
-  
-  f = fopen(prefix, "r");
+  ::stats = stats;
+}
 
-  //No null byte copied here, so prefix is not technically a string anymore.
-  prefix = (char *) realloc(prefix, prefix_len + 1);
+static void parse_pokemon_types(csv_t *f)
+{
+  csv_field_t field[3];
+  int i;
+  pokemon_types_db *pokemon_types;
 
-  fgets(line, 800, f);
-  
-  for (i = 1; i < 19; i++) {
-    fgets(line, 800, f); //  1
-    fgets(line, 800, f); //  3
-    fgets(line, 800, f); //  4
-    fgets(line, 800, f); //  5
-    fgets(line, 800, f); //  6
-    fgets(line, 800, f); //  7
-    fgets(line, 800, f); //  8
-    fgets(line, 800, f); //  9 - English
-    for (j = count = 0; count < 2; j++) {
-      if (line[j] == ',') {
-        count++;
-      }
-    }
-    line[strlen(line) - 1] = '\0';
-    types[i] = strdup(line + j);
-    fgets(line, 800, f); // 11
-    fgets(line, 800, f); // 12
+  pokemon_types = (pokemon_types_db *) calloc(NUM_POKEMON_TYPES,
+                                              sizeof (*pokemon_types));
+
+  csv_row(f, field, 0);
+
+  for (i = 1; i < NUM_POKEMON_TYPES && csv_row(f, field, 3) >= 0; i++) {
+    pokemon_types[i].pokemon_id = csv_int(field[0]);
+    pokemon_types[i].type_id = csv_int(field[1]);
+    pokemon_types[i].slot = csv_int(field[2]);
   }
 
-  fclose(f);
+  ::pokemon_types = pokemon_types;
+}
 
-  if (print) {
-    f = fopen("type_names.csv", "w");
-    for (i = 1; i < 19; i++) {
-      fprintf(f, "%s\n", types[i]);
+typedef struct db_table {
+  const char *file;
+  void (*parse)(csv_t *f);
+  double ms;
+} db_table_t;
+
+static db_table_t tables[] = {
+  { "pokemon.csv",         parse_pokemon,       0 },
+  { "moves.csv",           parse_moves,         0 },
+  { "pokemon_species.csv", parse_species,       0 },
+  { "experience.csv",      parse_experience,    0 },
+  { "type_names.csv",      parse_types,         0 },
+  { "pokemon_stats.csv",   parse_pokemon_stats, 0 },
+  { "stats.csv",           parse_stats,         0 },
+  { "pokemon_types.csv",   parse_pokemon_types, 0 },
+};
+
+# define NUM_TABLES (sizeof (tables) / sizeof (tables[0]))
+
+/* pokemon_moves.csv is far bigger than everything else put together, so *
+ * it is cut into one byte range per thread, each parsed into its own     *
+ * array.  Concatenating those in file order gives exactly the rows the   *
+ * serial parse would, so the result doesn't depend on the thread count.  */
+typedef struct moves_chunk {
+  const char *start, *end;
+  pokemon_move_db *rows;
+  int n;
+} moves_chunk_t;
+
+typedef struct db_load {
+  const char *prefix;
+  moves_chunk_t *chunk;
+  int num_chunks;
+  std::atomic<int> next;
+} db_load_t;
+
+static struct {
+  int compiled_in;
+  int from_snapshot;
+  int threads;
+  int async;
+  double total_ms;
+  double pokemon_moves_ms;
+  double wait_ms;
+} load_times;
+
+/* Never destroyed: a joinable std::thread left for static destructors *
+ * would abort an exit() that happens while the load is still running.  */
+static std::thread *loader;
+
+static void parse_chunk(moves_chunk_t *c)
+{
+  csv_t f;
+  TRACE_SCOPE("pokemon_moves.csv chunk", "db");
+
+  /* One more than the newlines, for a last line that lacks one */
+  c->rows = (pokemon_move_db *) malloc((csv_count_lines(c->start, c->end) +
+                                        1) * sizeof (*c->rows));
+  csv_init(&f, c->start, c->end);
+  c->n = parse_pokemon_moves(&f, c->rows);
+}
+
+static void run_table(const char *prefix, db_table_t *t)
+{
+  csv_file_t file;
+  csv_t f;
+  double start;
+  TRACE_SCOPE(t->file, "db");
+
+  start = now_ms();
+  csv_open(prefix, t->file, &file);
+  csv_init(&f, file.data, file.data + file.size);
+  t->parse(&f);
+  csv_unmap(&file);
+  t->ms = now_ms() - start;
+}
+
+/* Every thread, the caller included, takes the next unclaimed task until *
+ * none are left.  The chunks go first since they are the long pole.      */
+static void load_worker(db_load_t *l)
+{
+  int t;
+
+  while ((t = l->next++) < l->num_chunks + (int) NUM_TABLES) {
+    if (t < l->num_chunks) {
+      parse_chunk(l->chunk + t);
+    } else {
+      run_table(l->prefix, tables + t - l->num_chunks);
     }
-    fclose(f);
   }
+}
 
-  prefix = (char *) realloc(prefix,
-                            prefix_len + strlen("pokemon_stats.csv") + 1);
-  strcpy(prefix + prefix_len, "pokemon_stats.csv");
-  
-  f = fopen(prefix, "r");
+static void parse_csv(const char *prefix)
+{
+  db_load_t l;
+  std::vector<std::thread> workers;
+  csv_file_t file;
+  csv_t f;
+  csv_field_t header;
+  const char *p, *q;
+  pokemon_move_db *pokemon_moves;
+  double start;
+  int i, n, threads;
+
+  if ((threads = db_load_threads) <= 0 &&
+      (threads = std::thread::hardware_concurrency()) <= 0) {
+    threads = 1;
+  }
+  load_times.threads = threads;
+
+  start = now_ms();
+
+  csv_open(prefix, "pokemon_moves.csv", &file);
+  csv_init(&f, file.data, file.data + file.size);
+  csv_row(&f, &header, 0);
+
+  /* Cut at roughly even offsets, each pushed forward past a newline */
+  l.prefix = prefix;
+  l.num_chunks = threads;
+  l.chunk = (moves_chunk_t *) calloc(threads, sizeof (*l.chunk));
+  l.next = 0;
+  for (p = f.pos, i = 0; i < threads; i++) {
+    l.chunk[i].start = p;
+    if ((q = f.pos + (f.end - f.pos) * (i + 1) / threads) < p) {
+      q = p;
+    }
+    if (i == threads - 1 ||
+        !(q = (const char *) memchr(q, '\n', f.end - q))) {
+      q = f.end;
+    } else {
+      q++;
+    }
+    l.chunk[i].end = p = q;
+  }
 
-  //No null byte copied here, so prefix is not technically a string anymore.
-  prefix = (char *) realloc(prefix, prefix_len + 1);
+  for (i = 1; i < threads; i++) {
+    workers.push_back(std::thread(load_worker, &l));
+  }
+  load_worker(&l);
+  for (i = 0; i < (int) workers.size(); i++) {
+    workers[i].join();
+  }
 
-  fgets(line, 800, f);
-  
-  for (i = 1; i < 6553; i++) {
-    fgets(line, 800, f);
-    pokemon_stats[i].pokemon_id = atoi((tmp = next_token(line, ',')));
-    tmp = next_token(NULL, ',');
-    pokemon_stats[i].stat_id = *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    pokemon_stats[i].base_stat =  *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    pokemon_stats[i].effort =  (*tmp != '\n') ? atoi(tmp) : INT_MAX;
+  for (n = 0, i = 0; i < threads; i++) {
+    n += l.chunk[i].n;
   }
+  pokemon_moves = (pokemon_move_db *) malloc((n ? n : 1) *
+                                             sizeof (*pokemon_moves));
+  for (n = 0, i = 0; i < threads; i++) {
+    memcpy(pokemon_moves + n, l.chunk[i].rows,
+           l.chunk[i].n * sizeof (*pokemon_moves));
+    n += l.chunk[i].n;
+    free(l.chunk[i].rows);
+  }
+  free(l.chunk);
+  csv_unmap(&file);
 
-  fclose(f);
+  /* Stable, so rows within a level keep their CSV order */
+  trace_begin("sort pokemon_moves", "db");
+  std::stable_sort(pokemon_moves, pokemon_moves + n, learnset_order);
+  trace_end("sort pokemon_moves", "db");
+  ::pokemon_moves = pokemon_moves;
+  num_pokemon_moves = n;
+
+  load_times.pokemon_moves_ms = now_ms() - start;
+}
+
+char *db_csv_prefix()
+{
+  int i;
+  struct stat buf;
+  char *prefix;
+
+  i = (strlen(getenv("HOME")) +
+       strlen("/.poke327/pokedex/pokedex/data/csv/") + 1);
+  prefix = (char *) malloc(i);
+  strcpy(prefix, getenv("HOME"));
+  strcat(prefix, "/.poke327/pokedex/pokedex/data/csv/");
+
+  if (stat(prefix, &buf)) {
+    free(prefix);
+    prefix = NULL;
+  }
+
+  if (!prefix && !stat("/share/cs327", &buf)) {
+    prefix = strdup("/share/cs327/pokedex/pokedex/data/csv/");
+  } else if (!prefix) {
+    // Your third location goes here, if needed.
+    // prefix is freed later, so be sure you malloc it
+    prefix = strdup("../csv/");
+  }
+
+  return prefix;
+}
+
+void db_parse_csv(const char *prefix, bool missing_ok)
+{
+  csv_missing_ok = missing_ok;
+  parse_csv(prefix);
+  db_build_index();
+}
 
+void db_parse(bool print)
+{
+  char *prefix;
+  double start;
+  TRACE_SCOPE("db_parse", "db");
+
+#ifdef POKEDEX_STATIC
+  load_times.compiled_in = 1;
+  if (db_version_groups != pokedex_version_groups ||
+      db_move_methods != pokedex_move_methods) {
+    fprintf(stderr, "Warning: this build has its learnset filter compiled "
+            "in; --version-group and --move-method are ignored\n");
+    db_version_groups = pokedex_version_groups;
+    db_move_methods = pokedex_move_methods;
+  }
   if (print) {
-    f = fopen("pokemon_stats.csv", "w");
-    for (i = 1; i < 6553; i++) {
-      fprintf(f, "%s,%s,%s,%s\n",
-              i2s(pokemon_stats[i].pokemon_id),
-              i2s(pokemon_stats[i].stat_id),
-              i2s(pokemon_stats[i].base_stat),
-              i2s(pokemon_stats[i].effort));
-    }
-    fclose(f);
+    db_print();
   }
-  
-  prefix = (char *) realloc(prefix, prefix_len + strlen("stats.csv") + 1);
-  strcpy(prefix + prefix_len, "stats.csv");
-  
-  f = fopen(prefix, "r");
+  return;
+#endif
 
-  //No null byte copied here, so prefix is not technically a string anymore.
-  prefix = (char *) realloc(prefix, prefix_len + 1);
+  prefix = db_csv_prefix();
 
-  fgets(line, 800, f);
-  
-  for (i = 1; i < 9; i++) {
-    fgets(line, 800, f);
-    stats[i].id = atoi((tmp = next_token(line, ',')));
-    tmp = next_token(NULL, ',');
-    stats[i].damage_class_id = *tmp ? atoi(tmp) : INT_MAX;
-    strcpy(stats[i].identifier, (tmp = next_token(NULL, ',')));
-    tmp = next_token(NULL, ',');
-    stats[i].is_battle_only =  *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    stats[i].game_index =  (*tmp != '\n') ? atoi(tmp) : INT_MAX;
+  start = now_ms();
+
+  if (!db_snapshot_load(prefix)) {
+    load_times.from_snapshot = 1;
+    load_times.total_ms = now_ms() - start;
+    free(prefix);
+    if (print) {
+      db_print();
+    }
+    return;
   }
 
-  fclose(f);
-  
+  //No error checking on file load from here on out.  Missing
+  //files are "user error".
+  db_parse_csv(prefix, false);
+
+  free(prefix);
+
+  load_times.total_ms = now_ms() - start;
+
+  /* Next launch maps the parsed tables instead of doing all of this again */
+  db_snapshot_write();
+
   if (print) {
-    f = fopen("stats.csv", "w");
-    for (i = 1; i < 9; i++) {
-      fprintf(f, "%s,%s,%s,%s,%s\n",
-              i2s(stats[i].id),
-              i2s(stats[i].damage_class_id),
-              stats[i].identifier,
-              i2s(stats[i].is_battle_only),
-              i2s(stats[i].game_index));
-    }
-    fclose(f);
+    db_print();
   }
+}
 
-  prefix = (char *) realloc(prefix,
-                            prefix_len + strlen("pokemon_types.csv") + 1);
-  strcpy(prefix + prefix_len, "pokemon_types.csv");
-  
-  f = fopen(prefix, "r");
+void db_parse_async()
+{
+#ifdef POKEDEX_STATIC
+  /* Nothing to load, so no point in a thread */
+  db_parse(false);
+#else
+  load_times.async = 1;
+  loader = new std::thread(db_parse, false);
+#endif
+}
 
-  //No null byte copied here, so prefix is not technically a string anymore.
-  prefix = (char *) realloc(prefix, prefix_len + 1);
+void db_wait()
+{
+  double start;
+
+  if (loader) {
+    TRACE_SCOPE("db_wait", "db");
+    start = now_ms();
+    loader->join();
+    delete loader;
+    loader = NULL;
+    load_times.wait_ms = now_ms() - start;
+  }
+}
 
-  fgets(line, 800, f);
-  
-  for (i = 1; i < 1676; i++) {
-    fgets(line, 800, f);
-    pokemon_types[i].pokemon_id = atoi((tmp = next_token(line, ',')));
-    tmp = next_token(NULL, ',');
-    pokemon_types[i].type_id = *tmp ? atoi(tmp) : INT_MAX;
-    tmp = next_token(NULL, ',');
-    pokemon_types[i].slot = (*tmp != '\n') ? atoi(tmp) : INT_MAX;
+void db_print_load_times(FILE *f)
+{
+  uint32_t i;
+
+  if (load_times.compiled_in) {
+    fprintf(f, "Pokedex compiled in; nothing loaded\n");
+    return;
   }
 
-  fclose(f);
-  
-  if (print) {
-    f = fopen("pokemon_types.csv", "w");
-    for (i = 1; i < 1676; i++) {
-      fprintf(f, "%s,%s,%s\n",
-              i2s(pokemon_types[i].pokemon_id),
-              i2s(pokemon_types[i].type_id),
-              i2s(pokemon_types[i].slot));
-    }
-    fclose(f);
+  if (load_times.async) {
+    fprintf(f, "Pokedex loaded in the background; first use waited %.1f ms\n",
+            load_times.wait_ms);
   }
 
+  if (load_times.from_snapshot) {
+    fprintf(f, "Pokedex mapped from snapshot in %.1f ms\n",
+            load_times.total_ms);
+    return;
+  }
 
-  free(prefix);
+  fprintf(f, "Pokedex parsed from CSV in %.1f ms with %d thread%s\n",
+          load_times.total_ms, load_times.threads,
+          load_times.threads == 1 ? "" : "s");
+  fprintf(f, "  %-20s %8.1f ms\n", "pokemon_moves.csv",
+          load_times.pokemon_moves_ms);
+  for (i = 0; i < NUM_TABLES; i++) {
+    fprintf(f, "  %-20s %8.1f ms\n", tables[i].file, tables[i].ms);
+  }
 }
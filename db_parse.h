@@ -1,6 +1,9 @@
 #ifndef DB_PARSE_H
 # define DB_PARSE_H
 
+# include <stdint.h>
+# include <stdio.h>
+
 struct pokemon_db {
   int id;
   char identifier[30];
@@ -30,15 +33,19 @@ struct move_db {
   int super_contest_effect_id;
 };
 
+/* Only the filtered learnset rows are kept, so this one is packed.  *
+ * Empty fields hold DB_NONE16 rather than INT_MAX.                   */
 struct pokemon_move_db {
-  int pokemon_id;
-  int version_group_id;
-  int move_id;
-  int pokemon_move_method_id;
-  int level;
-  int order;
+  uint16_t pokemon_id;
+  uint16_t version_group_id;
+  uint16_t move_id;
+  uint16_t pokemon_move_method_id;
+  uint16_t level;
+  uint16_t order;
 };
 
+# define DB_NONE16 UINT16_MAX
+
 struct levelup_move {
   int level;
   int move;
@@ -94,16 +101,71 @@ struct pokemon_types_db {
   int slot;
 };
 
-extern pokemon_move_db pokemon_moves[528239];
-extern pokemon_db pokemon[1093];
-extern char *types[19];
-extern move_db moves[845];
-extern pokemon_species_db species[899];
-extern experience_db experience[601];
-extern pokemon_stats_db pokemon_stats[6553];
-extern stats_db stats[9];
-extern pokemon_types_db pokemon_types[1676];
+/* Row counts of each table, including the unused row 0.  For           *
+ * pokemon_moves this is the CSV row count; the kept table is smaller.  */
+# define NUM_POKEMON        1093
+# define NUM_MOVES          845
+# define NUM_POKEMON_MOVES  528239
+# define NUM_SPECIES        899
+# define NUM_EXPERIENCE     601
+# define NUM_POKEMON_STATS  6553
+# define NUM_STATS          9
+# define NUM_POKEMON_TYPES  1676
+# define NUM_TYPES          19
+
+/* The tables are read-only once loaded.  They point either into buffers *
+ * filled from the CSV files or directly into the mmapped snapshot.       */
+/* pokemon_moves has no unused row 0.  It holds num_pokemon_moves rows *
+ * that passed the filter below, sorted by (pokemon_id, level).         */
+extern const pokemon_move_db *pokemon_moves;
+extern int num_pokemon_moves;
+extern const pokemon_db *pokemon;
+extern const char *types[NUM_TYPES];
+extern const move_db *moves;
+extern const pokemon_species_db *species;
+extern const experience_db *experience;
+extern const pokemon_stats_db *pokemon_stats;
+extern const stats_db *stats;
+extern const pokemon_types_db *pokemon_types;
+
+/* Indexes over the tables, built once after parsing (or mapped along   *
+ * with the snapshot) so lookups never have to scan a whole table.       *
+ *                                                                       *
+ * pokemon_moves[learnset_offset[s]] .. pokemon_moves[learnset_offset[s *
+ * + 1] - 1] is the learnset of species s, lowest level first.           *
+ * move_index[id] is the moves row for move id, 0 if there is none.      *
+ * species_base_stats[s][stat_id - 1] is the base stat, INT_MAX if none. */
+extern const int *learnset_offset;
+extern const int *move_index;
+extern int num_move_ids;
+extern const int (*species_base_stats)[6];
+
+/* Bit n set keeps the pokemon_moves rows with version group (learn *
+ * method) id n; DB_ALL keeps every row.  Set these before db_parse. *
+ * The default is level-up moves from every version group.           */
+# define DB_ALL UINT32_MAX
+extern uint32_t db_version_groups;
+extern uint32_t db_move_methods;
+
+/* Threads used to parse the CSV files when there is no usable snapshot; *
+ * 0 means one per core.                                                 */
+extern int db_load_threads;
 
+/* Directory holding the pokedex CSV files, with a trailing slash. *
+ * The caller frees it.                                             */
+char *db_csv_prefix();
 void db_parse(bool print);
+/* Parses the CSV files under prefix and builds the indexes, without *
+ * touching the snapshot.  With missing_ok, a missing file leaves its *
+ * table zeroed instead of exiting.                                   */
+void db_parse_csv(const char *prefix, bool missing_ok);
+/* Runs db_parse(false) on a background thread.  Nothing may touch the *
+ * tables until db_wait() has returned; db_wait() is cheap once the    *
+ * load is done, so call it at the top of anything that uses them.     */
+void db_parse_async();
+void db_wait();
+void db_build_index();
+/* Where the time went in the last db_parse, one line per table. */
+void db_print_load_times(FILE *f);
 
 #endif
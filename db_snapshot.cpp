@@ -0,0 +1,318 @@
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "db_parse.h"
+#include "db_snapshot.h"
+#include "trace.h"
+
+#define SNAPSHOT_MAGIC    "PK327DB"
+#define SNAPSHOT_DIR      "/.poke327"
+#define SNAPSHOT_FILE     "/.poke327/pokedex.bin"
+#define SNAPSHOT_ALIGN    64
+#define TYPE_NAME_LEN     32
+
+typedef enum snapshot_table {
+  snap_pokemon,
+  snap_moves,
+  snap_pokemon_moves,
+  snap_species,
+  snap_experience,
+  snap_pokemon_stats,
+  snap_stats,
+  snap_pokemon_types,
+  snap_types,
+  snap_learnset_offset,
+  snap_move_index,
+  snap_base_stats,
+  num_snapshot_tables
+} snapshot_table_t;
+
+typedef struct snapshot_section {
+  uint32_t count;
+  uint32_t record_size;
+  uint64_t offset;
+} snapshot_section_t;
+
+typedef struct snapshot_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_tables;
+  uint32_t version_groups;
+  uint32_t move_methods;
+  snapshot_section_t table[num_snapshot_tables];
+} snapshot_header_t;
+
+/* Any of these being newer than the snapshot forces a reparse. */
+static const char *csv_files[] = {
+  "pokemon.csv",
+  "moves.csv",
+  "pokemon_moves.csv",
+  "pokemon_species.csv",
+  "experience.csv",
+  "type_names.csv",
+  "pokemon_stats.csv",
+  "stats.csv",
+  "pokemon_types.csv",
+};
+
+/* A count of zero marks a table whose length depends on the data. */
+static const snapshot_section_t expected[num_snapshot_tables] = {
+  { NUM_POKEMON,       sizeof (pokemon_db),         0 },
+  { NUM_MOVES,         sizeof (move_db),            0 },
+  { 0,                 sizeof (pokemon_move_db),    0 },
+  { NUM_SPECIES,       sizeof (pokemon_species_db), 0 },
+  { NUM_EXPERIENCE,    sizeof (experience_db),      0 },
+  { NUM_POKEMON_STATS, sizeof (pokemon_stats_db),   0 },
+  { NUM_STATS,         sizeof (stats_db),           0 },
+  { NUM_POKEMON_TYPES, sizeof (pokemon_types_db),   0 },
+  { NUM_TYPES,         TYPE_NAME_LEN,               0 },
+  { NUM_SPECIES + 1,   sizeof (int),                0 },
+  { 0,                 sizeof (int),                0 },
+  { NUM_SPECIES,       6 * sizeof (int),            0 },
+};
+
+static char *snapshot_path(const char *suffix)
+{
+  char *path;
+
+  path = (char *) malloc(strlen(getenv("HOME")) + strlen(SNAPSHOT_FILE) +
+                         strlen(suffix) + 1);
+  strcpy(path, getenv("HOME"));
+  strcat(path, SNAPSHOT_FILE);
+  strcat(path, suffix);
+
+  return path;
+}
+
+static int newer(const struct timespec *a, const struct timespec *b)
+{
+  return (a->tv_sec > b->tv_sec ||
+          (a->tv_sec == b->tv_sec && a->tv_nsec > b->tv_nsec));
+}
+
+static int snapshot_stale(const char *csv_prefix, const struct stat *snap)
+{
+  struct stat buf;
+  char *path;
+  uint32_t i;
+  int stale;
+
+  path = (char *) malloc(strlen(csv_prefix) + strlen("pokemon_species.csv") +
+                         1);
+
+  for (stale = 0, i = 0; !stale && i < sizeof (csv_files) /
+                                       sizeof (csv_files[0]); i++) {
+    strcpy(path, csv_prefix);
+    strcat(path, csv_files[i]);
+    /* A missing CSV is not a reason to throw away a good snapshot. */
+    if (!stat(path, &buf) && newer(&buf.st_mtim, &snap->st_mtim)) {
+      stale = 1;
+    }
+  }
+
+  free(path);
+
+  return stale;
+}
+
+int db_snapshot_load(const char *csv_prefix)
+{
+  char *path;
+  int fd;
+  struct stat buf;
+  const snapshot_header_t *h;
+  const char *base;
+  uint32_t i;
+  TRACE_SCOPE("db_snapshot_load", "db");
+
+  path = snapshot_path("");
+  fd = open(path, O_RDONLY);
+  free(path);
+
+  if (fd < 0) {
+    return 1;
+  }
+
+  if (fstat(fd, &buf) || buf.st_size < (off_t) sizeof (*h) ||
+      snapshot_stale(csv_prefix, &buf)) {
+    close(fd);
+    return 1;
+  }
+
+  /* The mapping stays alive for the life of the process; the fd does not *
+   * need to.                                                             */
+  base = (const char *) mmap(NULL, buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (base == MAP_FAILED) {
+    return 1;
+  }
+
+  h = (const snapshot_header_t *) base;
+
+  if (memcmp(h->magic, SNAPSHOT_MAGIC, sizeof (h->magic)) ||
+      h->version != DB_SNAPSHOT_VERSION ||
+      h->num_tables != num_snapshot_tables ||
+      h->version_groups != db_version_groups ||
+      h->move_methods != db_move_methods) {
+    munmap((void *) base, buf.st_size);
+    return 1;
+  }
+
+  for (i = 0; i < num_snapshot_tables; i++) {
+    if ((expected[i].count && h->table[i].count != expected[i].count) ||
+        h->table[i].record_size != expected[i].record_size           ||
+        h->table[i].offset % SNAPSHOT_ALIGN                          ||
+        h->table[i].offset + ((uint64_t) h->table[i].count *
+                              h->table[i].record_size) >
+        (uint64_t) buf.st_size) {
+      munmap((void *) base, buf.st_size);
+      return 1;
+    }
+  }
+
+  pokemon = (const pokemon_db *) (base + h->table[snap_pokemon].offset);
+  moves = (const move_db *) (base + h->table[snap_moves].offset);
+  pokemon_moves = (const pokemon_move_db *)
+                  (base + h->table[snap_pokemon_moves].offset);
+  num_pokemon_moves = h->table[snap_pokemon_moves].count;
+  species = (const pokemon_species_db *)
+            (base + h->table[snap_species].offset);
+  experience = (const experience_db *)
+               (base + h->table[snap_experience].offset);
+  pokemon_stats = (const pokemon_stats_db *)
+                  (base + h->table[snap_pokemon_stats].offset);
+  stats = (const stats_db *) (base + h->table[snap_stats].offset);
+  pokemon_types = (const pokemon_types_db *)
+                  (base + h->table[snap_pokemon_types].offset);
+  /* Row 0 is unused everywhere; keep it NULL like the CSV path does. */
+  types[0] = NULL;
+  for (i = 1; i < NUM_TYPES; i++) {
+    types[i] = base + h->table[snap_types].offset + i * TYPE_NAME_LEN;
+  }
+
+  learnset_offset = (const int *)
+                    (base + h->table[snap_learnset_offset].offset);
+  move_index = (const int *) (base + h->table[snap_move_index].offset);
+  num_move_ids = h->table[snap_move_index].count;
+  species_base_stats = (const int (*)[6])
+                       (base + h->table[snap_base_stats].offset);
+
+  /* Offsets must stay inside the rows actually stored */
+  if (learnset_offset[NUM_SPECIES] > num_pokemon_moves) {
+    munmap((void *) base, buf.st_size);
+    return 1;
+  }
+
+  return 0;
+}
+
+static int write_section(FILE *f, snapshot_section_t *s, const void *data)
+{
+  static const char zero[SNAPSHOT_ALIGN] = { 0 };
+  long pos;
+
+  pos = ftell(f);
+  if (pos % SNAPSHOT_ALIGN) {
+    fwrite(zero, 1, SNAPSHOT_ALIGN - (pos % SNAPSHOT_ALIGN), f);
+    pos = ftell(f);
+  }
+  s->offset = pos;
+
+  return fwrite(data, s->record_size, s->count, f) != s->count;
+}
+
+int db_snapshot_write(void)
+{
+  char *path, *tmp;
+  int fd;
+  FILE *f;
+  snapshot_header_t h;
+  char names[NUM_TYPES][TYPE_NAME_LEN];
+  const void *data[num_snapshot_tables];
+  uint32_t i;
+  int err;
+  TRACE_SCOPE("db_snapshot_write", "db");
+
+  path = (char *) malloc(strlen(getenv("HOME")) + strlen(SNAPSHOT_DIR) + 1);
+  strcpy(path, getenv("HOME"));
+  strcat(path, SNAPSHOT_DIR);
+  mkdir(path, 0755);
+  free(path);
+
+  memset(names, 0, sizeof (names));
+  for (i = 1; i < NUM_TYPES; i++) {
+    strncpy(names[i], types[i], TYPE_NAME_LEN - 1);
+  }
+
+  data[snap_pokemon] = pokemon;
+  data[snap_moves] = moves;
+  data[snap_pokemon_moves] = pokemon_moves;
+  data[snap_species] = species;
+  data[snap_experience] = experience;
+  data[snap_pokemon_stats] = pokemon_stats;
+  data[snap_stats] = stats;
+  data[snap_pokemon_types] = pokemon_types;
+  data[snap_types] = names;
+  data[snap_learnset_offset] = learnset_offset;
+  data[snap_move_index] = move_index;
+  data[snap_base_stats] = species_base_stats;
+
+  memset(&h, 0, sizeof (h));
+  memcpy(h.magic, SNAPSHOT_MAGIC, sizeof (h.magic));
+  h.version = DB_SNAPSHOT_VERSION;
+  h.num_tables = num_snapshot_tables;
+  memcpy(h.table, expected, sizeof (h.table));
+  h.version_groups = db_version_groups;
+  h.move_methods = db_move_methods;
+  h.table[snap_pokemon_moves].count = num_pokemon_moves;
+  h.table[snap_move_index].count = num_move_ids;
+
+  /* Write to a temporary and rename it into place, so that a concurrent *
+   * launch never maps a half-written snapshot.  Each writer gets its    *
+   * own temporary from mkstemp(); two cold launches may both be         *
+   * writing, and with different filters.  The last rename wins, and     *
+   * either snapshot is whole.                                           */
+  path = snapshot_path("");
+  tmp = snapshot_path(".XXXXXX");
+
+  if ((fd = mkstemp(tmp)) < 0) {
+    free(path);
+    free(tmp);
+    return 1;
+  }
+  if (!(f = fdopen(fd, "w"))) {
+    close(fd);
+    unlink(tmp);
+    free(path);
+    free(tmp);
+    return 1;
+  }
+
+  /* Header goes first as a placeholder, then again once offsets are known */
+  err = fwrite(&h, sizeof (h), 1, f) != 1;
+  for (i = 0; !err && i < num_snapshot_tables; i++) {
+    err = write_section(f, &h.table[i], data[i]);
+  }
+  if (!err) {
+    rewind(f);
+    err = fwrite(&h, sizeof (h), 1, f) != 1;
+  }
+  err = fclose(f) || err;
+
+  if (err || rename(tmp, path)) {
+    unlink(tmp);
+    err = 1;
+  }
+
+  free(path);
+  free(tmp);
+
+  return err;
+}
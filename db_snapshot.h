@@ -0,0 +1,19 @@
+#ifndef DB_SNAPSHOT_H
+# define DB_SNAPSHOT_H
+
+/* The snapshot is a single binary file holding every pokedex table as the *
+ * raw in-memory structs, so startup can mmap it instead of parsing CSV.   *
+ * Bump the version whenever a table struct or the layout changes; a       *
+ * snapshot with any other version is ignored and rebuilt.                 */
+# define DB_SNAPSHOT_VERSION 3
+
+/* Maps the snapshot and points the table globals into it.  Fails (returns *
+ * non-zero) if the snapshot is missing, malformed, from another version,  *
+ * built with a different learnset filter, or older than any of the CSV   *
+ * files under csv_prefix.                                                 */
+int db_snapshot_load(const char *csv_prefix);
+
+/* Writes the currently loaded tables out as a new snapshot. */
+int db_snapshot_write(void);
+
+#endif
@@ -0,0 +1,365 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "headless.h"
+#include "poke327.h"
+#include "io.h"
+
+int headless;
+
+typedef enum headless_policy {
+  policy_script,
+  policy_random,
+  policy_explore
+} headless_policy_t;
+
+static struct {
+  headless_policy_t policy;
+  char *script;        /* The whole file, NUL-terminated */
+  const char *next;    /* Next key in it                 */
+  uint32_t max_turns;
+} headless_pc;
+
+static struct {
+  uint32_t pc_turns, battles, wild, teleports;
+  uint32_t stuck;      /* PC turns in a row spent standing still */
+  struct timeval start;
+} headless_count;
+
+/* A policy's PC that can't move for this many turns, usually because *
+ * sentries have it boxed in, teleports as if 'p' had been pressed.   */
+#define HEADLESS_STUCK 8
+
+/* The explorer heads for the exit on one side of the map, the same side *
+ * as last time if this map has one, and follows dist, the number of    *
+ * steps from each cell to that exit.                                   */
+static struct {
+  map_t *map;          /* The map dist was built for    */
+  int side;            /* Index into exit_side          */
+  bool around;         /* dist avoids occupied cells    */
+  uint16_t dist[MAP_Y][MAP_X];
+} explore;
+
+#define EXPLORE_FAR UINT16_MAX
+
+static const struct {
+  int8_t map_t::*gate;
+  int16_t x, y;        /* -1 where the gate's offset goes */
+} exit_side[4] = {
+  { &map_t::n, -1,        0         },
+  { &map_t::e, MAP_X - 1, -1        },
+  { &map_t::s, -1,        MAP_Y - 1 },
+  { &map_t::w, 0,         -1        },
+};
+
+/* The move_pc_dir() input for a step of (dx, dy), as on a keypad */
+static uint32_t step_key(int dx, int dy)
+{
+  return (1 - dy) * 3 + dx + 2;
+}
+
+static uint32_t script_key(char c)
+{
+  switch (c) {
+  case 'y': return 7;
+  case 'k': return 8;
+  case 'u': return 9;
+  case 'l': return 6;
+  case 'n': return 3;
+  case 'j': return 2;
+  case 'b': return 1;
+  case 'h': return 4;
+  case ' ':
+  case '.': return 5;
+  }
+
+  return (c >= '1' && c <= '9') ? c - '0' : 0;
+}
+
+/* Steps in the first direction, going round from a random one, that *
+ * move_pc_dir() takes; rests if there is none.                      */
+static void move_random(pair_t dest)
+{
+  int i, k;
+
+  for (k = rand() & 0x7, i = 0; i < 8; i++, k = (k + 1) & 0x7) {
+    if (!move_pc_dir(step_key(all_dirs[k][dim_x], all_dirs[k][dim_y]),
+                     dest)) {
+      return;
+    }
+  }
+  dest[dim_x] = world.pc.pos[dim_x];
+  dest[dim_y] = world.pc.pos[dim_y];
+}
+
+/* Breadth-first from the exit, over cells the PC can enter, and with  *
+ * around, only those with nobody in them.  The rest of the border is  *
+ * left out; stepping on it would leave the map.                       */
+static void explore_map(map_t *m, bool around)
+{
+  static pair_t queue[MAP_X * MAP_Y];
+  uint32_t head, tail;
+  int16_t gx, gy;
+  int i, x, y;
+
+  gx = exit_side[explore.side].x;
+  gy = exit_side[explore.side].y;
+  if (gx < 0) {
+    gx = m->*exit_side[explore.side].gate;
+  } else {
+    gy = m->*exit_side[explore.side].gate;
+  }
+
+  explore.around = around;
+  for (y = 0; y < MAP_Y; y++) {
+    for (x = 0; x < MAP_X; x++) {
+      explore.dist[y][x] = EXPLORE_FAR;
+    }
+  }
+  explore.dist[gy][gx] = 0;
+  queue[0][dim_x] = gx;
+  queue[0][dim_y] = gy;
+  for (head = 0, tail = 1; head < tail; head++) {
+    for (i = 0; i < 8; i++) {
+      x = queue[head][dim_x] + all_dirs[i][dim_x];
+      y = queue[head][dim_y] + all_dirs[i][dim_y];
+      if (x < 1 || x > MAP_X - 2 || y < 1 || y > MAP_Y - 2 ||
+          explore.dist[y][x] != EXPLORE_FAR ||
+          move_cost[char_pc][m->map[y][x]] == INT_MAX ||
+          (around && m->cmap[y][x] > CMAP_PC)) {
+        continue;
+      }
+      explore.dist[y][x] = explore.dist[queue[head][dim_y]]
+                                       [queue[head][dim_x]] + 1;
+      queue[tail][dim_x] = x;
+      queue[tail][dim_y] = y;
+      tail++;
+    }
+  }
+}
+
+/* Keeps going the way the PC went last, or turns to a random side that *
+ * isn't the one it came in by, unless that is the only way out.       */
+static void explore_pick(map_t *m)
+{
+  int i, n, side[4];
+
+  explore.map = m;
+  if (m->*exit_side[explore.side].gate < 0) {
+    for (n = 0, i = 0; i < 4; i++) {
+      if (m->*exit_side[i].gate >= 0 && i != (explore.side + 2) % 4) {
+        side[n++] = i;
+      }
+    }
+    explore.side = n ? side[rand() % n] : (explore.side + 2) % 4;
+  }
+
+  explore_map(m, false);
+}
+
+/* Takes a step closer to the exit if there is one free */
+static bool explore_step(pair_t dest)
+{
+  int i, k, best, x, y;
+  uint16_t d;
+
+  d = explore.dist[world.pc.pos[dim_y]][world.pc.pos[dim_x]];
+  for (best = -1, k = rand() & 0x7, i = 0; i < 8; i++, k = (k + 1) & 0x7) {
+    x = world.pc.pos[dim_x] + all_dirs[k][dim_x];
+    y = world.pc.pos[dim_y] + all_dirs[k][dim_y];
+    if (explore.dist[y][x] < d &&
+        !(world.cur_map->cmap[y][x] > CMAP_PC &&
+          ((npc *) cmap_char(world.cur_map,
+                             world.cur_map->cmap[y][x]))->defeated)) {
+      d = explore.dist[y][x];
+      best = k;
+    }
+  }
+
+  return best >= 0 && !move_pc_dir(step_key(all_dirs[best][dim_x],
+                                            all_dirs[best][dim_y]), dest);
+}
+
+/* One step closer to the exit.  When someone is in the way, the way  *
+ * round everyone where they are now; the PC sticks to that, or it    *
+ * would keep turning back to the short way.  When there is no way    *
+ * round, it turns to the next exit and for now takes a random step.  */
+static void move_explore(pair_t dest)
+{
+  int i;
+
+  if (explore.map != world.cur_map) {
+    explore_pick(world.cur_map);
+  }
+
+  if (explore_step(dest)) {
+    return;
+  }
+  explore_map(world.cur_map, true);
+  if (explore_step(dest)) {
+    return;
+  }
+
+  if (explore.dist[world.pc.pos[dim_y]][world.pc.pos[dim_x]] == EXPLORE_FAR) {
+    for (i = 1; i < 4; i++) {
+      if (world.cur_map->*exit_side[(explore.side + i) % 4].gate >= 0) {
+        explore.side = (explore.side + i) % 4;
+        explore_map(world.cur_map, false);
+        break;
+      }
+    }
+  }
+  move_random(dest);
+}
+
+/* Keys the game would wait for that don't take a turn are skipped */
+static void move_script(pair_t dest)
+{
+  uint32_t key;
+
+  while (*headless_pc.next) {
+    if (*headless_pc.next == '#') {
+      headless_pc.next += strcspn(headless_pc.next, "\n");
+      continue;
+    }
+    if (*headless_pc.next++ == 'Q') {
+      break;
+    }
+    if ((key = script_key(headless_pc.next[-1])) && !move_pc_dir(key, dest)) {
+      return;
+    }
+  }
+
+  dest[dim_x] = world.pc.pos[dim_x];
+  dest[dim_y] = world.pc.pos[dim_y];
+  world.quit = 1;
+}
+
+static void move_headless_pc_func(character *c, pair_t dest)
+{
+  if (headless_pc.max_turns &&
+      headless_count.pc_turns == headless_pc.max_turns) {
+    dest[dim_x] = c->pos[dim_x];
+    dest[dim_y] = c->pos[dim_y];
+    world.quit = 1;
+    return;
+  }
+
+  if (!headless_count.pc_turns++) {
+    gettimeofday(&headless_count.start, NULL);
+  }
+
+  switch (headless_pc.policy) {
+  case policy_script:
+    move_script(dest);
+    return;
+  case policy_random:
+    move_random(dest);
+    break;
+  case policy_explore:
+    move_explore(dest);
+    break;
+  }
+
+  if (dest[dim_x] != c->pos[dim_x] || dest[dim_y] != c->pos[dim_y]) {
+    headless_count.stuck = 0;
+  } else if (++headless_count.stuck == HEADLESS_STUCK) {
+    io_teleport_pc(dest);
+    headless_count.stuck = 0;
+    headless_count.teleports++;
+  }
+}
+
+int headless_init(const char *how, uint32_t max_turns)
+{
+  FILE *f;
+  long size;
+
+  /* Each call starts a fresh run, so bench can make one per world */
+  free(headless_pc.script);
+  headless_pc.script = NULL;
+  memset(&headless_count, 0, sizeof (headless_count));
+  explore.map = NULL;
+  explore.side = 0;
+
+  if (!strcmp(how, "random")) {
+    headless_pc.policy = policy_random;
+    max_turns = max_turns ? max_turns : HEADLESS_TURNS;
+  } else if (!strcmp(how, "explore")) {
+    headless_pc.policy = policy_explore;
+    max_turns = max_turns ? max_turns : HEADLESS_TURNS;
+  } else {
+    if (!(f = fopen(how, "r"))) {
+      perror(how);
+      return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    rewind(f);
+    headless_pc.script = (char *) malloc(size + 1);
+    if (fread(headless_pc.script, 1, size, f) != (size_t) size) {
+      perror(how);
+      fclose(f);
+      return -1;
+    }
+    fclose(f);
+    headless_pc.script[size] = '\0';
+    headless_pc.next = headless_pc.script;
+    headless_pc.policy = policy_script;
+  }
+
+  headless_pc.max_turns = max_turns;
+  move_func[move_pc] = move_headless_pc_func;
+  headless = 1;
+
+  return 0;
+}
+
+/* Whoever it was is already marked defeated, so there is nothing *
+ * left to do but count it.                                       */
+void headless_battle(character *aggressor, character *defender)
+{
+  if (defender) {
+    headless_count.battles++;
+  } else {
+    headless_count.wild++;
+  }
+}
+
+void headless_print_stats(FILE *f)
+{
+  struct timeval end;
+  struct rusage ru;
+  uint32_t maps;
+  double s;
+  int x, y;
+
+  gettimeofday(&end, NULL);
+  getrusage(RUSAGE_SELF, &ru);
+  s = ((end.tv_sec - headless_count.start.tv_sec) +
+       (end.tv_usec - headless_count.start.tv_usec) / 1000000.0);
+
+  /* Less the first, made before the PC's first turn */
+  for (maps = 0, y = 0; y < WORLD_SIZE; y++) {
+    for (x = 0; x < WORLD_SIZE; x++) {
+      maps += !!world.world[y][x];
+    }
+  }
+  maps--;
+
+  fprintf(f, "Headless: %u PC turns, %llu turns in %.3fs, %.0f turns/s\n",
+          headless_count.pc_turns, (unsigned long long) game_turns, s,
+          s > 0 ? game_turns / s : 0);
+  fprintf(f, "  %u maps made, %.1f maps/s\n", maps, s > 0 ? maps / s : 0);
+  fprintf(f, "  %u trainer battles, %u wild, %u teleports\n",
+          headless_count.battles, headless_count.wild,
+          headless_count.teleports);
+  fprintf(f, "  Peak RSS %ld KiB\n", ru.ru_maxrss);
+
+  free(headless_pc.script);
+  headless_pc.script = NULL;
+}
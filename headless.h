@@ -0,0 +1,35 @@
+#ifndef HEADLESS_H
+# define HEADLESS_H
+
+# include <stdio.h>
+# include <stdint.h>
+
+class character;
+
+/* Runs the game with no terminal: nothing is drawn, battles are over as *
+ * soon as they start, and the PC is driven by a script or a policy in   *
+ * place of the keyboard.  Set up by headless_init(), which takes over   *
+ * move_func[move_pc].                                                   */
+extern int headless;
+
+/* PC turns a policy gets when it isn't given a limit */
+# define HEADLESS_TURNS 100000
+
+/* how is "random", a random walk, "explore", which heads for one exit  *
+ * after another, or the name of a script file: keys as the game takes  *
+ * them (digits or hjklyubn to move, 5, space or . to rest, Q to quit), *
+ * with newlines skipped and '#' starting a comment.  The game quits at *
+ * the end of the script or after max_turns PC turns; 0 means no limit  *
+ * for a script and HEADLESS_TURNS for a policy.  Fails (returns        *
+ * non-zero) if how is not a policy and can't be read.  Calling it      *
+ * again starts over, counts and all.                                   */
+int headless_init(const char *how, uint32_t max_turns);
+
+/* Called in place of the battle screens; defender is NULL for a wild *
+ * pokemon.                                                           */
+void headless_battle(character *aggressor, character *defender);
+
+/* Turns and maps per second since the PC's first turn, and peak RSS */
+void headless_print_stats(FILE *f);
+
+#endif
@@ -5,6 +5,32 @@
 
 #include "heap.h"
 
+#ifndef HEAP_DEFAULT_KIND
+# define HEAP_DEFAULT_KIND heap_fibonacci
+#endif
+
+#ifdef HEAP_TRACE
+void (*heap_trace)(heap_t *h, heap_op_t op, void *datum);
+# define trace(h, op, datum) ({                 \
+  if (heap_trace) {                             \
+    heap_trace((h), (op), (datum));             \
+  }                                             \
+})
+#else
+# define trace(h, op, datum)
+#endif
+
+const char *heap_kind_name[num_heap_kinds] = {
+  "fibonacci",
+  "quaternary",
+  "pairing",
+};
+
+/* Fibonacci nodes use every field.  Pairing nodes use child for their *
+ * leftmost child, next for the sibling to their right, and prev for   *
+ * the one to their left, or for the parent if they are leftmost.      *
+ * Quaternary nodes only need datum, and keep their slot in h->a in    *
+ * degree, which is what lets decrease-key find them.                  */
 struct heap_node {
   heap_node_t *next;
   heap_node_t *prev;
@@ -42,6 +68,59 @@ struct heap_node {
   (n)->prev->next = (n)->next;           \
 })
 
+/* Pooled heaps start with a slab of HEAP_SLAB_MIN nodes and double each *
+ * new one, up to HEAP_SLAB_MAX, so a big one-shot heap like the road    *
+ * builder's takes a handful of mallocs and a small, long-lived one like *
+ * a turn queue doesn't sit on thousands of unused nodes.               */
+#define HEAP_SLAB_MIN 32
+#define HEAP_SLAB_MAX 4096
+
+struct heap_slab {
+  struct heap_slab *next;
+  heap_node_t node[];
+};
+
+static heap_node_t *heap_node_alloc(heap_t *h)
+{
+  struct heap_slab *s;
+  heap_node_t *n;
+  uint32_t i;
+
+  if (!h->pooled) {
+    assert((n = calloc(1, sizeof (*n))));
+    return n;
+  }
+
+  if (!h->free) {
+    assert((s = malloc(sizeof (*s) + h->slab_nodes * sizeof (s->node[0]))));
+    s->next = h->slabs;
+    h->slabs = s;
+    for (i = 0; i < h->slab_nodes; i++) {
+      s->node[i].next = h->free;
+      h->free = &s->node[i];
+    }
+    if (h->slab_nodes < HEAP_SLAB_MAX) {
+      h->slab_nodes *= 2;
+    }
+  }
+
+  n = h->free;
+  h->free = n->next;
+  memset(n, 0, sizeof (*n));
+
+  return n;
+}
+
+static void heap_node_free(heap_t *h, heap_node_t *n)
+{
+  if (h->pooled) {
+    n->next = h->free;
+    h->free = n;
+  } else {
+    free(n);
+  }
+}
+
 void print_heap_node(heap_node_t *n, unsigned indent,
                      char *(*print)(const void *v))
 {
@@ -91,14 +170,37 @@ void print_heap_node_list(heap_node_t *n)
   printf("\n");
 }
 
-void heap_init(heap_t *h,
-               int32_t (*compare)(const void *key, const void *with),
-               void (*datum_delete)(void *))
+void heap_init_kind(heap_t *h, heap_kind_t kind, uint32_t pooled,
+                    int32_t (*compare)(const void *key, const void *with),
+                    void (*datum_delete)(void *))
 {
   h->min = NULL;
   h->size = 0;
   h->compare = compare;
   h->datum_delete = datum_delete;
+  h->kind = kind;
+  h->pooled = pooled;
+  h->slab_nodes = pooled ? HEAP_SLAB_MIN : 0;
+  h->slabs = NULL;
+  h->free = NULL;
+  h->a = NULL;
+  h->a_size = 0;
+
+  trace(h, heap_op_init, NULL);
+}
+
+void heap_init(heap_t *h,
+               int32_t (*compare)(const void *key, const void *with),
+               void (*datum_delete)(void *))
+{
+  heap_init_kind(h, HEAP_DEFAULT_KIND, 0, compare, datum_delete);
+}
+
+void heap_init_pool(heap_t *h,
+                    int32_t (*compare)(const void *key, const void *with),
+                    void (*datum_delete)(void *))
+{
+  heap_init_kind(h, HEAP_DEFAULT_KIND, 1, compare, datum_delete);
 }
 
 void heap_node_delete(heap_t *h, heap_node_t *hn)
@@ -114,39 +216,239 @@ void heap_node_delete(heap_t *h, heap_node_t *hn)
     if (h->datum_delete) {
       h->datum_delete(hn->datum);
     }
-    free(hn);
+    if (!h->pooled) {
+      free(hn);
+    }
     hn = next;
   }
 }
 
+static void pairing_node_delete(heap_t *h, heap_node_t *hn)
+{
+  heap_node_t *next;
+
+  for (; hn; hn = next) {
+    if (hn->child) {
+      pairing_node_delete(h, hn->child);
+    }
+    next = hn->next;
+    if (h->datum_delete) {
+      h->datum_delete(hn->datum);
+    }
+    if (!h->pooled) {
+      free(hn);
+    }
+  }
+}
+
 void heap_delete(heap_t *h)
 {
-  if (h->min) {
-    heap_node_delete(h, h->min);
+  struct heap_slab *s;
+  uint32_t i;
+
+  trace(h, heap_op_delete, NULL);
+
+  /* Pooled nodes go with their slabs, so only the data need a walk */
+  if (h->min && (!h->pooled || h->datum_delete)) {
+    switch (h->kind) {
+    case heap_fibonacci:
+      heap_node_delete(h, h->min);
+      break;
+    case heap_pairing:
+      pairing_node_delete(h, h->min);
+      break;
+    case heap_quaternary:
+      for (i = 0; i < h->size; i++) {
+        if (h->datum_delete) {
+          h->datum_delete(h->a[i]->datum);
+        }
+        if (!h->pooled) {
+          free(h->a[i]);
+        }
+      }
+      break;
+    default:
+      break;
+    }
   }
+  while ((s = h->slabs)) {
+    h->slabs = s->next;
+    free(s);
+  }
+  free(h->a);
   h->min = NULL;
   h->size = 0;
   h->compare = NULL;
   h->datum_delete = NULL;
+  h->pooled = 0;
+  h->slab_nodes = 0;
+  h->free = NULL;
+  h->a = NULL;
+  h->a_size = 0;
 }
 
-heap_node_t *heap_insert(heap_t *h, void *v)
+/* Implicit 4-ary heap: the children of slot i are 4i+1 to 4i+4.  Half  *
+ * the depth of a binary heap, and a node's four children usually sit  *
+ * in one cache line of h->a.                                           */
+static void quaternary_place(heap_t *h, heap_node_t *n, uint32_t i)
+{
+  h->a[i] = n;
+  n->degree = i;
+}
+
+static void quaternary_sift_up(heap_t *h, heap_node_t *n, uint32_t i)
+{
+  uint32_t p;
+
+  while (i && h->compare(n->datum, h->a[p = (i - 1) / 4]->datum) < 0) {
+    quaternary_place(h, h->a[p], i);
+    i = p;
+  }
+  quaternary_place(h, n, i);
+}
+
+static void quaternary_sift_down(heap_t *h, heap_node_t *n, uint32_t i)
+{
+  uint32_t c, j, end, best;
+
+  while ((c = 4 * i + 1) < h->size) {
+    end = c + 4 < h->size ? c + 4 : h->size;
+    for (best = c, j = c + 1; j < end; j++) {
+      if (h->compare(h->a[j]->datum, h->a[best]->datum) < 0) {
+        best = j;
+      }
+    }
+    if (h->compare(h->a[best]->datum, n->datum) >= 0) {
+      break;
+    }
+    quaternary_place(h, h->a[best], i);
+    i = best;
+  }
+  quaternary_place(h, n, i);
+}
+
+static void quaternary_insert(heap_t *h, heap_node_t *n)
+{
+  if (h->size == h->a_size) {
+    h->a_size = h->a_size ? h->a_size * 2 : 64;
+    assert((h->a = realloc(h->a, h->a_size * sizeof (*h->a))));
+  }
+  quaternary_sift_up(h, n, h->size);
+  h->min = h->a[0];
+}
+
+static void *quaternary_remove_min(heap_t *h)
 {
   heap_node_t *n;
+  void *v;
 
-  assert((n = calloc(1, sizeof (*n))));
-  n->datum = v;
+  n = h->a[0];
+  v = n->datum;
+  if (--h->size) {
+    quaternary_sift_down(h, h->a[h->size], 0);
+  }
+  h->min = h->size ? h->a[0] : NULL;
+  heap_node_free(h, n);
 
-  if (h->min) {
-    insert_heap_node_in_list(n, h->min);
+  return v;
+}
+
+/* Pairing heap: melding makes the larger root the leftmost child of   *
+ * the smaller, and remove-min melds the orphaned children in pairs    *
+ * left to right, then folds the pairs together right to left.         */
+static heap_node_t *pairing_meld(heap_t *h, heap_node_t *a, heap_node_t *b)
+{
+  if (h->compare(b->datum, a->datum) < 0) {
+    swap(a, b);
+  }
+  b->prev = a;
+  if ((b->next = a->child)) {
+    b->next->prev = b;
+  }
+  a->child = b;
+
+  return a;
+}
+
+static void *pairing_remove_min(heap_t *h)
+{
+  heap_node_t *n, *a, *b, *next, *pairs;
+  void *v;
+
+  n = h->min;
+  v = n->datum;
+
+  for (pairs = NULL, a = n->child; a; a = next) {
+    if ((b = a->next)) {
+      next = b->next;
+      a = pairing_meld(h, a, b);
+    } else {
+      next = NULL;
+    }
+    a->next = pairs;
+    pairs = a;
+  }
+
+  if ((h->min = pairs)) {
+    for (pairs = pairs->next; pairs; pairs = next) {
+      next = pairs->next;
+      h->min = pairing_meld(h, h->min, pairs);
+    }
+    h->min->next = h->min->prev = NULL;
+  }
+  heap_node_free(h, n);
+
+  return v;
+}
+
+static void pairing_decrease_key(heap_t *h, heap_node_t *n)
+{
+  if (n == h->min) {
+    return;
+  }
+
+  if (n->prev->child == n) {
+    n->prev->child = n->next;
   } else {
-    n->next = n->prev = n;
+    n->prev->next = n->next;
   }
-  if (!h->min || (h->compare(v, h->min->datum) < 0)) {
-    h->min = n;
+  if (n->next) {
+    n->next->prev = n->prev;
+  }
+  n->next = n->prev = NULL;
+
+  h->min = pairing_meld(h, h->min, n);
+}
+
+heap_node_t *heap_insert(heap_t *h, void *v)
+{
+  heap_node_t *n;
+
+  n = heap_node_alloc(h);
+  n->datum = v;
+
+  switch (h->kind) {
+  case heap_quaternary:
+    quaternary_insert(h, n);
+    break;
+  case heap_pairing:
+    h->min = h->min ? pairing_meld(h, h->min, n) : n;
+    break;
+  default:
+    if (h->min) {
+      insert_heap_node_in_list(n, h->min);
+    } else {
+      n->next = n->prev = n;
+    }
+    if (!h->min || (h->compare(v, h->min->datum) < 0)) {
+      h->min = n;
+    }
+    break;
   }
   h->size++;
 
+  trace(h, heap_op_insert, v);
+
   return n;
 }
 
@@ -210,7 +512,7 @@ static void heap_consolidate(heap_t *h)
   }
 }
 
-void *heap_remove_min(heap_t *h)
+static void *fibonacci_remove_min(heap_t *h)
 {
   void *v;
   heap_node_t *n;
@@ -220,7 +522,7 @@ void *heap_remove_min(heap_t *h)
   if (h->min) {
     v = h->min->datum;
     if (h->size == 1) {
-      free(h->min);
+      heap_node_free(h, h->min);
       h->min = NULL;
     } else {
       if ((n = h->min->child)) {
@@ -234,7 +536,7 @@ void *heap_remove_min(heap_t *h)
       n = h->min;
       remove_heap_node_from_list(n);
       h->min = n->next;
-      free(n);
+      heap_node_free(h, n);
 
       heap_consolidate(h);
     }
@@ -245,15 +547,50 @@ void *heap_remove_min(heap_t *h)
   return v;
 }
 
+void *heap_remove_min(heap_t *h)
+{
+  void *v;
+
+  if (!h->min) {
+    return NULL;
+  }
+
+  switch (h->kind) {
+  case heap_quaternary:
+    v = quaternary_remove_min(h);
+    break;
+  case heap_pairing:
+    v = pairing_remove_min(h);
+    h->size--;
+    break;
+  default:
+    v = fibonacci_remove_min(h);
+    break;
+  }
+
+  trace(h, heap_op_remove_min, v);
+
+  return v;
+}
+
 int heap_combine(heap_t *h, heap_t *h1, heap_t *h2)
 {
   if (h1->compare != h2->compare ||
-      h1->datum_delete != h2->datum_delete) {
+      h1->datum_delete != h2->datum_delete ||
+      h1->kind != heap_fibonacci || h2->kind != heap_fibonacci ||
+      h1->pooled || h2->pooled) {
     return 1;
   }
 
   h->compare = h1->compare;
   h->datum_delete = h1->datum_delete;
+  h->kind = heap_fibonacci;
+  h->pooled = 0;
+  h->slab_nodes = 0;
+  h->slabs = NULL;
+  h->free = NULL;
+  h->a = NULL;
+  h->a_size = 0;
 
   if (!h1->min) {
     h->min = h2->min;
@@ -325,16 +662,29 @@ int heap_decrease_key_no_replace(heap_t *h, heap_node_t *n)
 
   heap_node_t *p;
 
-  p = n->parent;
-
-  if (p && (h->compare(n->datum, p->datum) < 0)) {
-    heap_cut(h, n, p);
-    heap_cascading_cut(h, p);
-  }
-  if (h->compare(n->datum, h->min->datum) < 0) {
-    h->min = n;
+  switch (h->kind) {
+  case heap_quaternary:
+    quaternary_sift_up(h, n, n->degree);
+    h->min = h->a[0];
+    break;
+  case heap_pairing:
+    pairing_decrease_key(h, n);
+    break;
+  default:
+    p = n->parent;
+
+    if (p && (h->compare(n->datum, p->datum) < 0)) {
+      heap_cut(h, n, p);
+      heap_cascading_cut(h, p);
+    }
+    if (h->compare(n->datum, h->min->datum) < 0) {
+      h->min = n;
+    }
+    break;
   }
 
+  trace(h, heap_op_decrease_key, n->datum);
+
   return 0;
 }
 
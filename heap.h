@@ -9,17 +9,56 @@ extern "C" {
 
 struct heap_node;
 typedef struct heap_node heap_node_t;
+struct heap_slab;
+
+/* Every kind supports the whole API except heap_combine(), which is *
+ * Fibonacci only.  They differ in the order they return equal keys. */
+typedef enum heap_kind {
+  heap_fibonacci,
+  heap_quaternary,  /* Implicit 4-ary heap in an array */
+  heap_pairing,
+  num_heap_kinds
+} heap_kind_t;
+
+extern const char *heap_kind_name[num_heap_kinds];
 
 typedef struct heap {
   heap_node_t *min;
   uint32_t size;
   int32_t (*compare)(const void *key, const void *with);
   void (*datum_delete)(void *);
+  heap_kind_t kind;
+  /* Node pool; only used by heaps set up with heap_init_pool() */
+  uint32_t pooled;
+  uint32_t slab_nodes;
+  struct heap_slab *slabs;
+  heap_node_t *free;
+  /* The array behind a heap_quaternary heap */
+  heap_node_t **a;
+  uint32_t a_size;
 } heap_t;
 
 void heap_init(heap_t *h,
                int32_t (*compare)(const void *key, const void *with),
                void (*datum_delete)(void *));
+/* Like heap_init(), but nodes are carved out of slabs owned by the heap *
+ * and recycled through a free list instead of going back to free().    *
+ * Once the heap has grown to its working size, inserts and removals    *
+ * never call malloc() again.  heap_delete() releases every slab at     *
+ * once.  Pooled heaps can't be combined.                               *
+ *                                                                      *
+ * The game itself no longer makes heap_ts: paths and turns are queued  *
+ * in pqueue.h, which allocates nothing.  The pool, like the kinds, is  *
+ * now only used by "./bench heap", to compare against them.            */
+void heap_init_pool(heap_t *h,
+                    int32_t (*compare)(const void *key, const void *with),
+                    void (*datum_delete)(void *));
+/* heap_init() and heap_init_pool() make HEAP_DEFAULT_KIND heaps, which *
+ * is heap_fibonacci unless heap.c is built with something else.  This  *
+ * picks the kind for a single heap.                                    */
+void heap_init_kind(heap_t *h, heap_kind_t kind, uint32_t pooled,
+                    int32_t (*compare)(const void *key, const void *with),
+                    void (*datum_delete)(void *));
 void heap_delete(heap_t *h);
 heap_node_t *heap_insert(heap_t *h, void *v);
 void *heap_peek_min(heap_t *h);
@@ -28,6 +67,19 @@ int heap_combine(heap_t *h, heap_t *h1, heap_t *h2);
 int heap_decrease_key(heap_t *h, heap_node_t *n, void *v);
 int heap_decrease_key_no_replace(heap_t *h, heap_node_t *n);
 
+/* Only in heap.c built with -DHEAP_TRACE, as the bench's heap_trace.o *
+ * is.  While set, it is called after every init, insert, decrease-key *
+ * and remove-min, and before every delete, on every heap.             */
+typedef enum heap_op {
+  heap_op_init,
+  heap_op_insert,
+  heap_op_decrease_key,
+  heap_op_remove_min,
+  heap_op_delete
+} heap_op_t;
+
+extern void (*heap_trace)(heap_t *h, heap_op_t op, void *datum);
+
 # ifdef __cplusplus
 }
 # endif
@@ -9,6 +9,10 @@ using namespace std;
 
 #include "io.h"
 #include "poke327.h"
+#include "headless.h"
+#include "journal.h"
+#include "prof.h"
+#include "trace.h"
 
 typedef struct io_message {
   /* Will print " --more-- " at end of line when another message follows. *
@@ -87,7 +91,7 @@ static void io_print_message_queue(uint32_t y, uint32_t x)
       mvprintw(y, x + 70, "%10s", " --more-- ");
       attroff(COLOR_PAIR(COLOR_CYAN));
       refresh();
-      getch();
+      journal_getch();
     }
     free(io_tail);
   }
@@ -121,14 +125,14 @@ static character *io_nearest_visible_trainer()
   /* Get a linear list of trainers */
   for (count = 0, y = 1; y < MAP_Y - 1; y++) {
     for (x = 1; x < MAP_X - 1; x++) {
-      if (world.cur_map->cmap[y][x] && world.cur_map->cmap[y][x] !=
-          &world.pc) {
-        c[count++] = world.cur_map->cmap[y][x];
+      if (world.cur_map->cmap[y][x] > CMAP_PC) {
+        c[count++] = cmap_char(world.cur_map, world.cur_map->cmap[y][x]);
       }
     }
   }
 
   /* Sort it by distance from PC */
+  pathfind_update();
   qsort(c, count, sizeof (*c), compare_trainer_distance);
 
   n = c[0];
@@ -142,12 +146,21 @@ void io_display()
 {
   uint32_t y, x;
   character *c;
+  PROF_SCOPE(prof_io_display);
+  TRACE_SCOPE("io_display", "io");
+
+  if (journal_replaying) {
+    /* Nothing to draw on, but --more-- still takes its keys */
+    io_print_message_queue(0, 0);
+    return;
+  }
 
   clear();
   for (y = 0; y < MAP_Y; y++) {
     for (x = 0; x < MAP_X; x++) {
       if (world.cur_map->cmap[y][x]) {
-        mvaddch(y + 1, x, world.cur_map->cmap[y][x]->symbol);
+        mvaddch(y + 1, x,
+                cmap_char(world.cur_map, world.cur_map->cmap[y][x])->symbol);
       } else {
         switch (world.cur_map->map[y][x]) {
         case ter_boulder:
@@ -226,6 +239,10 @@ void io_display()
     attroff(COLOR_PAIR(COLOR_BLUE));
   }
 
+  if (prof_overlay) {
+    prof_draw(22);
+  }
+
   io_print_message_queue(0, 0);
 
   refresh();
@@ -235,13 +252,15 @@ uint32_t io_teleport_pc(pair_t dest)
 {
   /* Just for fun. And debugging.  Mostly debugging. */
 
+  pathfind_update();
+
   do {
     dest[dim_x] = rand_range(1, MAP_X - 2);
     dest[dim_y] = rand_range(1, MAP_Y - 2);
   } while (world.cur_map->cmap[dest[dim_y]][dest[dim_x]]                  ||
            move_cost[char_pc][world.cur_map->map[dest[dim_y]]
                                                 [dest[dim_x]]] == INT_MAX ||
-           world.rival_dist[dest[dim_y]][dest[dim_x]] < 0);
+           world.rival_dist[dest[dim_y]][dest[dim_x]] == DIST_UNREACHABLE);
 
   return 0;
 }
@@ -257,7 +276,7 @@ static void io_scroll_trainer_list(char (*s)[40], uint32_t count)
     for (i = 0; i < 13; i++) {
       mvprintw(i + 6, 19, " %-40s ", s[i + offset]);
     }
-    switch (getch()) {
+    switch (journal_getch()) {
     case KEY_UP:
       if (offset) {
         offset--;
@@ -309,7 +328,7 @@ static void io_list_trainers_display(npc **c,
   if (count <= 13) {
     mvprintw(count + 6, 19, " %-40s ", "");
     mvprintw(count + 7, 19, " %-40s ", "Hit escape to continue.");
-    while (getch() != 27 /* escape */)
+    while (journal_getch() != 27 /* escape */)
       ;
   } else {
     mvprintw(19, 19, " %-40s ", "");
@@ -331,14 +350,15 @@ static void io_list_trainers()
   /* Get a linear list of trainers */
   for (count = 0, y = 1; y < MAP_Y - 1; y++) {
     for (x = 1; x < MAP_X - 1; x++) {
-      if (world.cur_map->cmap[y][x] && world.cur_map->cmap[y][x] !=
-          &world.pc) {
-        c[count++] = (npc *) world.cur_map->cmap[y][x];
+      if (world.cur_map->cmap[y][x] > CMAP_PC) {
+        c[count++] = (npc *) cmap_char(world.cur_map,
+                                       world.cur_map->cmap[y][x]);
       }
     }
   }
 
   /* Sort it by distance from PC */
+  pathfind_update();
   qsort(c, count, sizeof (*c), compare_trainer_distance);
 
   /* Display it */
@@ -353,20 +373,21 @@ void io_pokemart()
 {
   mvprintw(0, 0, "Welcome to the Pokemart.  Could I interest you in some Pokeballs?");
   refresh();
-  getch();
+  journal_getch();
 }
 
 void io_pokemon_center()
 {
   mvprintw(0, 0, "Welcome to the Pokemon Center.  How can Nurse Joy assist you?");
   refresh();
-  getch();
+  journal_getch();
 }
 
 
 uint32_t move_pc_dir(uint32_t input, pair_t dest)
 {
   int has_moved = 0;
+  character *c;
   dest[dim_y] = world.pc.pos[dim_y];
   dest[dim_x] = world.pc.pos[dim_x];
 
@@ -422,14 +443,13 @@ uint32_t move_pc_dir(uint32_t input, pair_t dest)
     io_display_wild_battle();
   }
 
-  if (world.cur_map->cmap[dest[dim_y]][dest[dim_x]]) {
-    if (dynamic_cast<npc *>(world.cur_map->cmap[dest[dim_y]][dest[dim_x]]) &&
-        ((npc *) world.cur_map->cmap[dest[dim_y]][dest[dim_x]])->defeated) {
+  if ((c = cmap_char(world.cur_map,
+                     world.cur_map->cmap[dest[dim_y]][dest[dim_x]]))) {
+    if (c->ctype != char_pc && ((npc *) c)->defeated) {
       // Some kind of greeting here would be nice
       return 1;
-    } else if (dynamic_cast<npc *>
-               (world.cur_map->cmap[dest[dim_y]][dest[dim_x]])) {
-      io_battle(&world.pc, world.cur_map->cmap[dest[dim_y]][dest[dim_x]]);
+    } else if (c->ctype != char_pc) {
+      io_battle(&world.pc, c);
       // Not actually moving, so set dest back to PC position
       dest[dim_x] = world.pc.pos[dim_x];
       dest[dim_y] = world.pc.pos[dim_y];
@@ -445,13 +465,42 @@ uint32_t move_pc_dir(uint32_t input, pair_t dest)
 }
 
 
+/* Fills in one move slot of a pokemon from the moves table.  Unknown *
+ * ids (including 0, for an empty learnset) give a blank move.        */
+static void set_move(char *name, int *priority, int *accuracy, int *power,
+                     int id)
+{
+  const move_db *m;
+
+  if(id > 0 && id < num_move_ids && move_index[id]){
+    m = &moves[move_index[id]];
+    strcpy(name, m->identifier);
+    *priority = m->priority;
+    *accuracy = m->accuracy;
+    *power = m->power;
+  }else{
+    name[0] = '\0';
+    *priority = *accuracy = *power = 0;
+  }
+}
+
 pokemon_t create_pokemon(){
   pokemon_t poke;
   float range;
   int move1_id,move2_id;
+  int i;
+  const int *stat;
+  PROF_SCOPE(prof_create_pokemon);
+  TRACE_SCOPE("create_pokemon", "pokemon");
   int ran = rand() % 1092;
-  int dist = (abs(world.cur_idx[dim_x])-200) + (abs(world.cur_idx[dim_y])-200);
-  int species_id = pokemon[ran].species_id;
+  int dist = (abs(world.cur_idx[dim_x] - WORLD_SIZE / 2) +
+              abs(world.cur_idx[dim_y] - WORLD_SIZE / 2));
+  int species_id;
+
+  // The pokedex may still be loading; this is the first thing to need it.
+  db_wait();
+
+  species_id = pokemon[ran].species_id;
   poke.species_id = species_id;
   strcpy(poke.name,pokemon[ran].identifier);
 
@@ -462,50 +511,44 @@ pokemon_t create_pokemon(){
   }
   poke.level = rand() % ((int)range) + 1;
 
-  for(int i = 0; i < 528239; i++){
-    if(pokemon_moves[i].pokemon_id == species_id){
-      move1_id = pokemon_moves[i].move_id;
-      move2_id = pokemon_moves[i+1].move_id;
-      break;
+  /* The species' first learnset row and the one after it, as when this *
+   * scanned pokemon_moves; a one-row learnset gives the move twice.     */
+  move1_id = move2_id = 0;
+  if(species_id >= 0 && species_id < NUM_SPECIES &&
+     learnset_offset[species_id] != learnset_offset[species_id + 1]){
+    i = learnset_offset[species_id];
+    move1_id = move2_id = pokemon_moves[i].move_id;
+    if(i + 1 < learnset_offset[species_id + 1]){
+      move2_id = pokemon_moves[i + 1].move_id;
     }
   }
-  
-  for(int i = 0; i < 845; i++){
-    if(move1_id == moves[i].id){
-      strcpy(poke.move1,moves[i].identifier);
-      poke.move1_priority = moves[i].priority;
-      poke.move1_accuracy = moves[i].accuracy;
-      poke.move1_power = moves[i].power;
+
+  set_move(poke.move1, &poke.move1_priority, &poke.move1_accuracy,
+           &poke.move1_power, move1_id);
+  set_move(poke.move2, &poke.move2_priority, &poke.move2_accuracy,
+           &poke.move2_power, move2_id);
+
+  if(species_id >= 0 && species_id < NUM_SPECIES){
+    /* Same order as the stat rows, so rand() is drawn identically */
+    stat = species_base_stats[species_id];
+    if(stat[0] != INT_MAX){
+      poke.hp = stat[0] + rand() % 15;
+      poke.current_hp = poke.hp;
     }
-    if(move2_id == moves[i].id){
-      strcpy(poke.move2,moves[i].identifier);
-      poke.move2_priority = moves[i].priority;
-      poke.move2_accuracy = moves[i].accuracy;
-      poke.move2_power = moves[i].power;
+    if(stat[1] != INT_MAX){
+      poke.attack = stat[1] + rand() % 15;
     }
-  }
-
-  for(int i = 0; i < 6553; i++){
-    if(pokemon_stats[i].pokemon_id == species_id){
-      if(pokemon_stats[i].stat_id == 1){
-        poke.hp = pokemon_stats[i].base_stat + rand() % 15;
-        poke.current_hp = poke.hp;
-      }
-      if(pokemon_stats[i].stat_id == 2){
-        poke.attack = pokemon_stats[i].base_stat + rand() % 15;
-      }
-      if(pokemon_stats[i].stat_id == 3){
-        poke.defense = pokemon_stats[i].base_stat + rand() % 15;
-      }
-      if(pokemon_stats[i].stat_id == 4){
-        poke.special_attack = pokemon_stats[i].base_stat + rand() % 15;
-      }
-      if(pokemon_stats[i].stat_id == 5){
-        poke.special_defense = pokemon_stats[i].base_stat + rand() % 15;
-      }
-      if(pokemon_stats[i].stat_id == 6){
-        poke.speed = pokemon_stats[i].base_stat + rand() % 15;
-      }
+    if(stat[2] != INT_MAX){
+      poke.defense = stat[2] + rand() % 15;
+    }
+    if(stat[3] != INT_MAX){
+      poke.special_attack = stat[3] + rand() % 15;
+    }
+    if(stat[4] != INT_MAX){
+      poke.special_defense = stat[4] + rand() % 15;
+    }
+    if(stat[5] != INT_MAX){
+      poke.speed = stat[5] + rand() % 15;
     }
   }
   poke.gender = rand() % 2;
@@ -524,14 +567,14 @@ void io_clear(){
 
 char io_pc_select(){
   io_clear();
-  char key;
+  char key = 0;
   for(int i = 0; i < 6; i++){
     mvprintw(i,0,"%d - %s",i,world.pokemon_pc[i].name);
   }
 
   while(key != '0' && key != '1' && key != '2' && key != '3' && key != '4' && key != '5'){
     mvprintw(0,30,"- select your pokemon to fight with -");
-    key = getch();
+    key = journal_getch();
   }
   return key;
 }
@@ -542,14 +585,19 @@ void io_display_wild_battle(){
   int damage_pc = 0;
   int damage_npc = 0;
   int turn = 0;
-  char key;
+  char key = 0;
   int poke_select;
   int i = rand() % 7;
+  TRACE_SCOPE("wild battle", "battle");
   p = create_pokemon();
   poke_select = 0;
+  if (headless) {
+    headless_battle(&world.pc, NULL);
+    return;
+  }
   while(key != 'q' && quit != 1){
     i = rand() % 7;
-    key = getch();
+    key = journal_getch();
 
   io_clear();
   mvprintw(0,25,"enter q to quit");
@@ -597,7 +645,7 @@ void io_display_wild_battle(){
   if(key == '1' && world.pokemon_pc[poke_select].current_hp > 0){
     turn = 1;
     while(key_move != 'a' && key_move != 'b'){ 
-      key_move = getch();
+      key_move = journal_getch();
       mvprintw(6,25,"choose move a(1) or b(2)");
       refresh();
     }
@@ -635,7 +683,7 @@ void io_display_wild_battle(){
       mvprintw(4,0,"4 - %s",world.pokemon_pc[4].name);
       mvprintw(5,0,"5 - %s",world.pokemon_pc[5].name);
       refresh();
-      key_bag = getch();
+      key_bag = journal_getch();
     }
     poke_select = key_bag - '0';
   }
@@ -647,7 +695,7 @@ void io_display_wild_battle(){
       mvprintw(1,0,"b - revive %dx",world.revives);
       mvprintw(2,0,"c - pokeball %dx",world.balls);
       refresh();
-      key_bag = getch();
+      key_bag = journal_getch();
       if(key_bag == 'a'){
         if(world.pokemon_pc[poke_select].current_hp + 20 > world.pokemon_pc[poke_select].hp){
           world.pokemon_pc[poke_select].current_hp = world.pokemon_pc[poke_select].hp;
@@ -688,13 +736,18 @@ void io_display_wild_battle(){
 void io_battle(character *aggressor, character *defender)
 {
   npc *n = (npc *) ((aggressor == &world.pc) ? defender : aggressor);
+  TRACE_SCOPE("trainer battle", "battle");
 
   n->defeated = 1;
   if (n->ctype == char_hiker || n->ctype == char_rival) {
     n->mtype = move_wander;
   }
+  if (headless) {
+    headless_battle(aggressor, defender);
+    return;
+  }
 
-  char key;
+  char key = 0;
   int poke_select;
   poke_select = 0;
   while(key != 'q'){
@@ -703,17 +756,17 @@ void io_battle(character *aggressor, character *defender)
   mvprintw(0,30,"enter q to flee");
 
   mvprintw(0,0,"Wild Pokemon");
-  mvprintw(1,0,"pokemon: %s",defender->pokemon_char[0].name);
-  mvprintw(2,0,"level: %d",defender->pokemon_char[0].level);
-  mvprintw(3,0,"Move 1: %s",defender->pokemon_char[0].move1);
-  mvprintw(4,0,"Move 2: %s",defender->pokemon_char[0].move2);
-  mvprintw(5,0,"HP: %d",defender->pokemon_char[0].hp);
-  mvprintw(6,0,"attack: %d",defender->pokemon_char[0].attack);
-  mvprintw(7,0,"defense: %d",defender->pokemon_char[0].defense);
-  mvprintw(8,0,"special-attack: %d",defender->pokemon_char[0].special_attack);
-  mvprintw(9,0,"special-defense: %d",defender->pokemon_char[0].special_defense);
-  mvprintw(10,0,"speed: %d",defender->pokemon_char[0].speed);
-  if(defender->pokemon_char[0].gender == 0){
+  mvprintw(1,0,"pokemon: %s",char_party(defender)[0].name);
+  mvprintw(2,0,"level: %d",char_party(defender)[0].level);
+  mvprintw(3,0,"Move 1: %s",char_party(defender)[0].move1);
+  mvprintw(4,0,"Move 2: %s",char_party(defender)[0].move2);
+  mvprintw(5,0,"HP: %d",char_party(defender)[0].hp);
+  mvprintw(6,0,"attack: %d",char_party(defender)[0].attack);
+  mvprintw(7,0,"defense: %d",char_party(defender)[0].defense);
+  mvprintw(8,0,"special-attack: %d",char_party(defender)[0].special_attack);
+  mvprintw(9,0,"special-defense: %d",char_party(defender)[0].special_defense);
+  mvprintw(10,0,"speed: %d",char_party(defender)[0].speed);
+  if(char_party(defender)[0].gender == 0){
     mvprintw(11,0,"Male");
   }else{
     mvprintw(11,0,"Female");
@@ -737,7 +790,7 @@ void io_battle(character *aggressor, character *defender)
   }
 
   refresh();
-    key = getch();
+    key = journal_getch();
   }
 
 }
@@ -747,7 +800,7 @@ void select_pokemon(){
   poke1 = create_pokemon();
   poke2 = create_pokemon();
   poke3 = create_pokemon();
-  char key;
+  char key = 0;
 
   while(key != '1' && key != '2' && key != '3'){
     mvprintw(0,0,"select a starter pokemon from the 3 provided");
@@ -755,7 +808,7 @@ void select_pokemon(){
     mvprintw(2,0,"pokemon 2: %s",poke2.name);
     mvprintw(3,0,"pokemon 3: %s",poke3.name);
     refresh();
-    key = getch();
+    key = journal_getch();
   }
   if(key == '1'){
     world.pokemon_pc[0] = poke1;
@@ -778,7 +831,7 @@ void list_trainers(){
       {
         mvprintw(y,x,"*");
         for(int i = 0; i < 6; i++){
-          mvprintw(i,j,"%s",world.cur_map->cmap[y][x]->pokemon_char[i].name);
+          mvprintw(i,j,"%s",char_party(cmap_char(world.cur_map, world.cur_map->cmap[y][x]))[i].name);
         }
         j += 10;
       }
@@ -790,6 +843,8 @@ void list_trainers(){
 
 void init_pokemon_trainers(){
   int i, ran;
+  PROF_SCOPE(prof_init_pokemon_trainers);
+  TRACE_SCOPE("init_pokemon_trainers", "map");
 
   for(int x = 0; x < MAP_X; x++)
   {
@@ -801,7 +856,8 @@ void init_pokemon_trainers(){
         i = 0;
         while((i < 6 && ran <= 6) || i == 0)
         {
-          world.cur_map->cmap[y][x]->pokemon_char[i] = create_pokemon();
+          char_party(cmap_char(world.cur_map, world.cur_map->cmap[y][x]))[i] =
+            create_pokemon();
           ran = rand() % 10 + 1;
           i++;
         }
@@ -818,24 +874,31 @@ void io_teleport_world(pair_t dest)
    * values and accept their updates only if in range.                */
   int x = INT_MAX, y = INT_MAX;
   
-  world.cur_map->cmap[world.pc.pos[dim_y]][world.pc.pos[dim_x]] = NULL;
+  world.cur_map->cmap[world.pc.pos[dim_y]][world.pc.pos[dim_x]] = CMAP_NONE;
 
-  echo();
-  curs_set(1);
-  do {
-    mvprintw(0, 0, "Enter x [-200, 200]:           ");
-    refresh();
-    mvscanw(0, 21, "%d", &x);
-  } while (x < -200 || x > 200);
-  do {
-    mvprintw(0, 0, "Enter y [-200, 200]:          ");
-    refresh();
-    mvscanw(0, 21, "%d", &y);
-  } while (y < -200 || y > 200);
+  /* mvscanw() reads its own keys, so the journal keeps the numbers */
+  if (!journal_replaying) {
+    PROF_WAITING();
 
-  refresh();
-  noecho();
-  curs_set(0);
+    echo();
+    curs_set(1);
+    do {
+      mvprintw(0, 0, "Enter x [-200, 200]:           ");
+      refresh();
+      mvscanw(0, 21, "%d", &x);
+    } while (x < -200 || x > 200);
+    do {
+      mvprintw(0, 0, "Enter y [-200, 200]:          ");
+      refresh();
+      mvscanw(0, 21, "%d", &y);
+    } while (y < -200 || y > 200);
+
+    refresh();
+    noecho();
+    curs_set(0);
+  }
+  journal_number(&x);
+  journal_number(&y);
 
   x += 200;
   y += 200;
@@ -853,7 +916,7 @@ void io_handle_input(pair_t dest)
   int key;
 
   do {
-    switch (key = getch()) {
+    switch (key = journal_getch()) {
     case '7':
     case 'y':
     case KEY_HOME:
@@ -916,6 +979,12 @@ void io_handle_input(pair_t dest)
       io_list_trainers();
       turn_not_consumed = 1;
       break;
+    case 'P':
+      /* Timings in place of the status lines, or back again */
+      prof_overlay = !prof_overlay;
+      io_display();
+      turn_not_consumed = 1;
+      break;
     case 'p':
       /* Teleport the PC to a random place in the map.               */
       io_teleport_pc(dest);
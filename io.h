@@ -31,6 +31,8 @@ void io_init_terminal(void);
 void io_reset_terminal(void);
 void io_display(void);
 void io_handle_input(pair_t dest);
+uint32_t move_pc_dir(uint32_t input, pair_t dest);
+uint32_t io_teleport_pc(pair_t dest);
 void io_queue_message(const char *format, ...);
 void io_battle(character_t *aggressor, character_t *defender);
 void encounter();
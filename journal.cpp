@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <ncurses.h>
+
+#include "journal.h"
+#include "poke327.h"
+#include "db_parse.h"
+#include "prof.h"
+
+/* The file is a header:                                                *
+ *                                                                      *
+ *   "PKJ1", then the seed, db_version_groups and db_move_methods       *
+ *                                                                      *
+ * and then records, each a tag byte and what follows it:               *
+ *                                                                      *
+ *   0x00-0x7f   a key, the tag itself; almost all of them              *
+ *   0x80        a key outside that, like KEY_UP, in the next 2 bytes   *
+ *   0x81        the hash after a PC turn, in the next 4                *
+ *   0x82        a number typed at a prompt, in the next 4              *
+ *                                                                      *
+ * All numbers are little-endian.  A game of a few thousand keys comes  *
+ * to a few tens of KiB, most of it hashes.                             */
+#define JOURNAL_MAGIC  "PKJ1"
+#define JOURNAL_HEADER 16
+
+/* FNV-1a's offset basis */
+#define JOURNAL_HASH   2166136261u
+
+typedef enum journal_tag {
+  tag_key = 0x80,
+  tag_hash,
+  tag_number
+} journal_tag_t;
+
+int journal_replaying;
+
+static struct {
+  FILE *out;           /* Recording                               */
+  uint8_t *in;         /* Replaying: the whole file               */
+  uint32_t size, next; /* Its length and the next byte to be read */
+  const char *path;
+  uint32_t hash;       /* Of every turn so far                    */
+  uint32_t pc_turns, keys;
+  struct timeval start;
+} journal;
+
+static void put32(uint32_t v)
+{
+  putc(v & 0xff, journal.out);
+  putc((v >> 8) & 0xff, journal.out);
+  putc((v >> 16) & 0xff, journal.out);
+  putc(v >> 24, journal.out);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+/* Ends a replay that has gone off the journal.  It may be deep in a *
+ * battle screen, so there is no going back up to game_loop().       */
+static void journal_diverged(const char *what)
+{
+  fprintf(stderr, "%s: replay diverged at PC turn %u (turn %llu): %s\n",
+          journal.path, journal.pc_turns, (unsigned long long) game_turns,
+          what);
+  exit(1);
+}
+
+/* The next record on replay, which must be tagged tag; returns where *
+ * what follows the tag starts.                                       */
+static const uint8_t *journal_next(journal_tag_t tag, uint32_t len)
+{
+  const uint8_t *p;
+
+  if (journal.next == journal.size) {
+    journal_diverged(tag == tag_hash ? "journal ends before this turn" :
+                                       "journal ends waiting for a key");
+  }
+  p = journal.in + journal.next;
+  if (tag == tag_key && *p < tag_key) {
+    len = 0;
+  } else if (*p != tag) {
+    journal_diverged(tag == tag_key ? "game wants a key" :
+                     tag == tag_hash ? "turn ends before its keys do" :
+                                       "game wants a number");
+  }
+  if (journal.size - journal.next < len + 1) {
+    journal_diverged("journal is cut short");
+  }
+  journal.next += len + 1;
+
+  return p + 1;
+}
+
+int journal_record(const char *path, uint32_t seed)
+{
+  if (!(journal.out = fopen(path, "wb"))) {
+    perror(path);
+    return -1;
+  }
+  journal.path = path;
+  journal.hash = JOURNAL_HASH;
+
+  fwrite(JOURNAL_MAGIC, 1, 4, journal.out);
+  put32(seed);
+  put32(db_version_groups);
+  put32(db_move_methods);
+
+  return 0;
+}
+
+int journal_replay(const char *path, uint32_t *seed)
+{
+  FILE *f;
+  long size;
+
+  if (!(f = fopen(path, "rb"))) {
+    perror(path);
+    return -1;
+  }
+  fseek(f, 0, SEEK_END);
+  size = ftell(f);
+  rewind(f);
+  journal.in = (uint8_t *) malloc(size ? size : 1);
+  if (fread(journal.in, 1, size, f) != (size_t) size) {
+    perror(path);
+    fclose(f);
+    return -1;
+  }
+  fclose(f);
+
+  if (size < JOURNAL_HEADER || memcmp(journal.in, JOURNAL_MAGIC, 4)) {
+    fprintf(stderr, "%s: not a journal\n", path);
+    return -1;
+  }
+  journal.path = path;
+  journal.hash = JOURNAL_HASH;
+  journal.size = size;
+  journal.next = JOURNAL_HEADER;
+  *seed = get32(journal.in + 4);
+  db_version_groups = get32(journal.in + 8);
+  db_move_methods = get32(journal.in + 12);
+  journal_replaying = 1;
+
+  return 0;
+}
+
+static int journal_wait_key(void)
+{
+  PROF_WAITING();
+
+  return getch();
+}
+
+int journal_getch(void)
+{
+  const uint8_t *p;
+  int key;
+
+  if (journal_replaying) {
+    p = journal_next(tag_key, 2);
+    journal.keys++;
+    return (p[-1] < tag_key) ? p[-1] : (int16_t) (p[0] | (p[1] << 8));
+  }
+
+  key = journal_wait_key();
+  if (journal.out) {
+    if (key >= 0 && key < tag_key) {
+      putc(key, journal.out);
+    } else {
+      putc(tag_key, journal.out);
+      putc(key & 0xff, journal.out);
+      putc((key >> 8) & 0xff, journal.out);
+    }
+    journal.keys++;
+  }
+
+  return key;
+}
+
+void journal_number(int *v)
+{
+  if (journal_replaying) {
+    *v = (int32_t) get32(journal_next(tag_number, 4));
+  } else if (journal.out) {
+    putc(tag_number, journal.out);
+    put32(*v);
+  }
+}
+
+static inline void hash_word(uint32_t v)
+{
+  int i;
+
+  /* FNV-1a, a byte at a time */
+  for (i = 0; i < 4; i++, v >>= 8) {
+    journal.hash = (journal.hash ^ (v & 0xff)) * 16777619u;
+  }
+}
+
+void journal_turn(character *c)
+{
+  if (!journal.out && !journal_replaying) {
+    return;
+  }
+
+  if (!journal.start.tv_sec) {
+    gettimeofday(&journal.start, NULL);
+  }
+  hash_word(c->ctype | (c->mtype << 8) | (c->pos[dim_x] << 16));
+  hash_word(c->pos[dim_y] | (c->next_turn << 8));
+  if (c->ctype != char_pc) {
+    return;
+  }
+
+  hash_word(world.cur_idx[dim_x] | (world.cur_idx[dim_y] << 16));
+  journal.pc_turns++;
+  if (journal_replaying) {
+    if (get32(journal_next(tag_hash, 4)) != journal.hash) {
+      journal_diverged("world hash doesn't match");
+    }
+  } else {
+    putc(tag_hash, journal.out);
+    put32(journal.hash);
+    /* A game that crashes leaves a journal that replays up to the crash */
+    fflush(journal.out);
+  }
+}
+
+int journal_close(FILE *f)
+{
+  struct timeval end;
+  double s;
+  int rc;
+
+  rc = 0;
+  if (journal.out) {
+    fprintf(f, "Recorded %u keys over %u PC turns in %s\n",
+            journal.keys, journal.pc_turns, journal.path);
+    fclose(journal.out);
+    journal.out = NULL;
+  } else if (journal_replaying) {
+    gettimeofday(&end, NULL);
+    s = ((end.tv_sec - journal.start.tv_sec) +
+         (end.tv_usec - journal.start.tv_usec) / 1000000.0);
+    if ((rc = journal.next != journal.size)) {
+      fprintf(f, "%s: replay quit with %u bytes of journal left\n",
+              journal.path, journal.size - journal.next);
+    }
+    fprintf(f, "Replayed %u keys over %u PC turns, %llu turns in %.3fs, "
+            "%.0f turns/s\n", journal.keys, journal.pc_turns,
+            (unsigned long long) game_turns, s, s > 0 ? game_turns / s : 0);
+    free(journal.in);
+    journal.in = NULL;
+    journal_replaying = 0;
+  }
+
+  return rc;
+}
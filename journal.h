@@ -0,0 +1,41 @@
+#ifndef JOURNAL_H
+# define JOURNAL_H
+
+# include <stdio.h>
+# include <stdint.h>
+
+class character;
+
+/* A journal is what it takes to play a game again exactly: the seed,   *
+ * the pokedex filters and every key the player pressed, with a hash of *
+ * the world after each PC turn.  Replay feeds the keys back in with no *
+ * terminal and nothing drawn, and stops at the first hash that doesn't *
+ * match.                                                               */
+extern int journal_replaying;
+
+/* Starts a journal in path for a game with this seed; call it once the *
+ * seed and the filters are settled.  Fails (returns non-zero) if path   *
+ * can't be written.                                                     */
+int journal_record(const char *path, uint32_t seed);
+
+/* Opens the journal in path and puts its filters in place, so call it *
+ * before db_parse_async().  Fails if path isn't a journal.            */
+int journal_replay(const char *path, uint32_t *seed);
+
+/* getch() for io.cpp: the next key in the journal on replay, otherwise *
+ * the keyboard's, logged if recording.                                 */
+int journal_getch(void);
+
+/* A number the player typed at a prompt, which the journal keeps in *
+ * place of its keys.                                                */
+void journal_number(int *v);
+
+/* Folds a finished turn into the hash, and after the PC's, logs or *
+ * checks it.  On replay, a mismatch ends the game.                 */
+void journal_turn(character *c);
+
+/* Closes the journal and, on replay, reports how fast it went.  Returns *
+ * non-zero if the replay didn't end where the journal does.             */
+int journal_close(FILE *f);
+
+#endif
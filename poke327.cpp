@@ -9,10 +9,13 @@
 #include <assert.h>
 #include <unistd.h>
 
-#include "heap.h"
 #include "poke327.h"
 #include "io.h"
 #include "db_parse.h"
+#include "headless.h"
+#include "journal.h"
+#include "prof.h"
+#include "trace.h"
 
 typedef struct queue_node {
   int x, y;
@@ -20,6 +23,7 @@ typedef struct queue_node {
 } queue_node_t;
 
 world_t world;
+uint64_t game_turns;
 
 pair_t all_dirs[8] = {
   { -1, -1 },
@@ -32,10 +36,6 @@ pair_t all_dirs[8] = {
   {  1,  1 },
 };
 
-static int32_t path_cmp(const void *key, const void *with) {
-  return ((path_t *) key)->cost - ((path_t *) with)->cost;
-}
-
 static int32_t edge_penalty(int8_t x, int8_t y)
 {
   return (x == 1 || y == 1 || x == MAP_X - 2 || y == MAP_Y - 2) ? 2 : 1;
@@ -45,8 +45,9 @@ static void dijkstra_path(map_t *m, pair_t from, pair_t to)
 {
   static path_t path[MAP_Y][MAP_X], *p;
   static uint32_t initialized = 0;
-  heap_t h;
+  path_queue_t q;
   int32_t x, y;
+  PROF_SCOPE(prof_dijkstra_path);
 
   if (!initialized) {
     for (y = 0; y < MAP_Y; y++) {
@@ -66,17 +67,15 @@ static void dijkstra_path(map_t *m, pair_t from, pair_t to)
 
   path[from[dim_y]][from[dim_x]].cost = 0;
 
-  heap_init(&h, path_cmp, NULL);
+  q.init();
 
   for (y = 1; y < MAP_Y - 1; y++) {
     for (x = 1; x < MAP_X - 1; x++) {
-      path[y][x].hn = heap_insert(&h, &path[y][x]);
+      q.insert(&path[y][x]);
     }
   }
 
-  while ((p = (path_t *) heap_remove_min(&h))) {
-    p->hn = NULL;
-
+  while ((p = q.remove_min())) {
     if ((p->pos[dim_y] == to[dim_y]) && p->pos[dim_x] == to[dim_x]) {
       for (x = to[dim_x], y = to[dim_y];
            (x != from[dim_x]) || (y != from[dim_y]);
@@ -84,11 +83,11 @@ static void dijkstra_path(map_t *m, pair_t from, pair_t to)
         mapxy(x, y) = ter_path;
         heightxy(x, y) = 0;
       }
-      heap_delete(&h);
+      q.destroy();
       return;
     }
 
-    if ((path[p->pos[dim_y] - 1][p->pos[dim_x]    ].hn) &&
+    if ((path[p->pos[dim_y] - 1][p->pos[dim_x]    ].node.queued) &&
         (path[p->pos[dim_y] - 1][p->pos[dim_x]    ].cost >
          ((p->cost + heightpair(p->pos)) *
           edge_penalty(p->pos[dim_x], p->pos[dim_y] - 1)))) {
@@ -97,10 +96,10 @@ static void dijkstra_path(map_t *m, pair_t from, pair_t to)
          edge_penalty(p->pos[dim_x], p->pos[dim_y] - 1));
       path[p->pos[dim_y] - 1][p->pos[dim_x]    ].from[dim_y] = p->pos[dim_y];
       path[p->pos[dim_y] - 1][p->pos[dim_x]    ].from[dim_x] = p->pos[dim_x];
-      heap_decrease_key_no_replace(&h, path[p->pos[dim_y] - 1]
-                                           [p->pos[dim_x]    ].hn);
+      q.decrease_key(&path[p->pos[dim_y] - 1]
+                          [p->pos[dim_x]    ]);
     }
-    if ((path[p->pos[dim_y]    ][p->pos[dim_x] - 1].hn) &&
+    if ((path[p->pos[dim_y]    ][p->pos[dim_x] - 1].node.queued) &&
         (path[p->pos[dim_y]    ][p->pos[dim_x] - 1].cost >
          ((p->cost + heightpair(p->pos)) *
           edge_penalty(p->pos[dim_x] - 1, p->pos[dim_y])))) {
@@ -109,10 +108,10 @@ static void dijkstra_path(map_t *m, pair_t from, pair_t to)
          edge_penalty(p->pos[dim_x] - 1, p->pos[dim_y]));
       path[p->pos[dim_y]    ][p->pos[dim_x] - 1].from[dim_y] = p->pos[dim_y];
       path[p->pos[dim_y]    ][p->pos[dim_x] - 1].from[dim_x] = p->pos[dim_x];
-      heap_decrease_key_no_replace(&h, path[p->pos[dim_y]    ]
-                                           [p->pos[dim_x] - 1].hn);
+      q.decrease_key(&path[p->pos[dim_y]    ]
+                          [p->pos[dim_x] - 1]);
     }
-    if ((path[p->pos[dim_y]    ][p->pos[dim_x] + 1].hn) &&
+    if ((path[p->pos[dim_y]    ][p->pos[dim_x] + 1].node.queued) &&
         (path[p->pos[dim_y]    ][p->pos[dim_x] + 1].cost >
          ((p->cost + heightpair(p->pos)) *
           edge_penalty(p->pos[dim_x] + 1, p->pos[dim_y])))) {
@@ -121,10 +120,10 @@ static void dijkstra_path(map_t *m, pair_t from, pair_t to)
          edge_penalty(p->pos[dim_x] + 1, p->pos[dim_y]));
       path[p->pos[dim_y]    ][p->pos[dim_x] + 1].from[dim_y] = p->pos[dim_y];
       path[p->pos[dim_y]    ][p->pos[dim_x] + 1].from[dim_x] = p->pos[dim_x];
-      heap_decrease_key_no_replace(&h, path[p->pos[dim_y]    ]
-                                           [p->pos[dim_x] + 1].hn);
+      q.decrease_key(&path[p->pos[dim_y]    ]
+                          [p->pos[dim_x] + 1]);
     }
-    if ((path[p->pos[dim_y] + 1][p->pos[dim_x]    ].hn) &&
+    if ((path[p->pos[dim_y] + 1][p->pos[dim_x]    ].node.queued) &&
         (path[p->pos[dim_y] + 1][p->pos[dim_x]    ].cost >
          ((p->cost + heightpair(p->pos)) *
           edge_penalty(p->pos[dim_x], p->pos[dim_y] + 1)))) {
@@ -133,15 +132,17 @@ static void dijkstra_path(map_t *m, pair_t from, pair_t to)
          edge_penalty(p->pos[dim_x], p->pos[dim_y] + 1));
       path[p->pos[dim_y] + 1][p->pos[dim_x]    ].from[dim_y] = p->pos[dim_y];
       path[p->pos[dim_y] + 1][p->pos[dim_x]    ].from[dim_x] = p->pos[dim_x];
-      heap_decrease_key_no_replace(&h, path[p->pos[dim_y] + 1]
-                                           [p->pos[dim_x]    ].hn);
+      q.decrease_key(&path[p->pos[dim_y] + 1]
+                          [p->pos[dim_x]    ]);
     }
   }
+  q.destroy();
 }
 
-static int build_paths(map_t *m)
+int build_paths(map_t *m)
 {
   pair_t from, to;
+  TRACE_SCOPE("build_paths", "map");
 
   /*  printf("%d %d %d %d\n", m->n, m->s, m->e, m->w);*/
 
@@ -238,13 +239,14 @@ static int gaussian[5][5] = {
   {  1,  4,  7,  4,  1 }
 };
 
-static int smooth_height(map_t *m)
+int smooth_height(map_t *m)
 {
   int32_t i, x, y;
   int32_t s, t, p, q;
   queue_node_t *head, *tail, *tmp;
   /*  FILE *out;*/
   uint8_t height[MAP_Y][MAP_X];
+  TRACE_SCOPE("smooth_height", "map");
 
   memset(&height, 0, sizeof (height));
 
@@ -429,6 +431,7 @@ static void find_building_location(map_t *m, pair_t p)
 static int place_pokemart(map_t *m)
 {
   pair_t p;
+  TRACE_SCOPE("place_pokemart", "map");
 
   find_building_location(m, p);
 
@@ -442,6 +445,7 @@ static int place_pokemart(map_t *m)
 
 static int place_center(map_t *m)
 {  pair_t p;
+  TRACE_SCOPE("place_center", "map");
 
   find_building_location(m, p);
 
@@ -453,7 +457,7 @@ static int place_center(map_t *m)
   return 0;
 }
 
-static int map_terrain(map_t *m, int8_t n, int8_t s, int8_t e, int8_t w)
+int map_terrain(map_t *m, int8_t n, int8_t s, int8_t e, int8_t w)
 {
   int32_t i, x, y;
   queue_node_t *head, *tail, *tmp;
@@ -461,6 +465,7 @@ static int map_terrain(map_t *m, int8_t n, int8_t s, int8_t e, int8_t w)
   int num_grass, num_clearing, num_mountain, num_forest, num_total;
   terrain_type_t type;
   int added_current = 0;
+  TRACE_SCOPE("map_terrain", "map");
   
   num_grass = rand() % 4 + 2;
   num_clearing = rand() % 4 + 2;
@@ -637,6 +642,7 @@ static int place_boulders(map_t *m)
 {
   int i;
   int x, y;
+  TRACE_SCOPE("place_boulders", "map");
 
   for (i = 0; i < MIN_BOULDERS || rand() % 100 < BOULDER_PROB; i++) {
     y = rand() % (MAP_Y - 2) + 1;
@@ -653,6 +659,7 @@ static int place_trees(map_t *m)
 {
   int i;
   int x, y;
+  TRACE_SCOPE("place_trees", "map");
   
   for (i = 0; i < MIN_TREES || rand() % 100 < TREE_PROB; i++) {
     y = rand() % (MAP_Y - 2) + 1;
@@ -671,30 +678,53 @@ void rand_pos(pair_t pos)
   pos[dim_y] = (rand() % (MAP_Y - 2)) + 1;
 }
 
+/* Appends an NPC at pos to the current map.  npcs and party only grow *
+ * while place_characters() runs, and nothing points into them until   *
+ * it has finished and queued everyone.                                 */
+static npc *new_npc(pair_t pos)
+{
+  map_t *m = world.cur_map;
+  npc *c;
+
+  if (m->num_trainers == m->max_trainers) {
+    m->max_trainers = m->max_trainers ? m->max_trainers * 2 : 16;
+    m->npcs = (npc *) realloc(m->npcs, m->max_trainers * sizeof (*m->npcs));
+    m->party = (pokemon_t (*)[6]) realloc(m->party, (m->max_trainers *
+                                                     sizeof (*m->party)));
+  }
+
+  memset(m->party[m->num_trainers], 0, sizeof (m->party[0]));
+  m->cmap[pos[dim_y]][pos[dim_x]] = CMAP_NPC + m->num_trainers;
+  c = m->npcs + m->num_trainers++;
+  c->pos[dim_y] = pos[dim_y];
+  c->pos[dim_x] = pos[dim_x];
+  c->defeated = 0;
+  c->parked = 0;
+  c->next_turn = 0;
+
+  return c;
+}
+
 void new_hiker()
 {
   pair_t pos;
   npc *c;
 
+  pathfind_update();
+
   do {
     rand_pos(pos);
-  } while (world.hiker_dist[pos[dim_y]][pos[dim_x]] == INT_MAX ||
-           world.cur_map->cmap[pos[dim_y]][pos[dim_x]]         ||
-           pos[dim_x] < 3 || pos[dim_x] > MAP_X - 4            ||
+  } while (world.hiker_dist[pos[dim_y]][pos[dim_x]] == DIST_UNREACHABLE ||
+           world.cur_map->cmap[pos[dim_y]][pos[dim_x]]                  ||
+           pos[dim_x] < 3 || pos[dim_x] > MAP_X - 4                     ||
            pos[dim_y] < 3 || pos[dim_y] > MAP_Y - 4);
 
-  world.cur_map->cmap[pos[dim_y]][pos[dim_x]] = c = new npc;
-  c->pos[dim_y] = pos[dim_y];
-  c->pos[dim_x] = pos[dim_x];
+  c = new_npc(pos);
   c->ctype = char_hiker;
   c->mtype = move_hiker;
   c->dir[dim_x] = 0;
   c->dir[dim_y] = 0;
-  c->defeated = 0;
   c->symbol = 'h';
-  c->next_turn = 0;
-  heap_insert(&world.cur_map->turn, c);
-  world.cur_map->cmap[pos[dim_y]][pos[dim_x]] = c;
 
   //  printf("Hiker at %d,%d\n", pos[dim_x], pos[dim_y]);
 }
@@ -704,26 +734,21 @@ void new_rival()
   pair_t pos;
   npc *c;
 
+  pathfind_update();
+
   do {
     rand_pos(pos);
-  } while (world.rival_dist[pos[dim_y]][pos[dim_x]] == INT_MAX ||
-           world.rival_dist[pos[dim_y]][pos[dim_x]] < 0        ||
-           world.cur_map->cmap[pos[dim_y]][pos[dim_x]]         ||
-           pos[dim_x] < 3 || pos[dim_x] > MAP_X - 4            ||
+  } while (world.rival_dist[pos[dim_y]][pos[dim_x]] == DIST_UNREACHABLE ||
+           world.cur_map->cmap[pos[dim_y]][pos[dim_x]]                  ||
+           pos[dim_x] < 3 || pos[dim_x] > MAP_X - 4                     ||
            pos[dim_y] < 3 || pos[dim_y] > MAP_Y - 4);
 
-  world.cur_map->cmap[pos[dim_y]][pos[dim_x]] = c = new npc;
-  c->pos[dim_y] = pos[dim_y];
-  c->pos[dim_x] = pos[dim_x];
+  c = new_npc(pos);
   c->ctype = char_rival;
   c->mtype = move_rival;
   c->dir[dim_x] = 0;
   c->dir[dim_y] = 0;
-  c->defeated = 0;
   c->symbol = 'r';
-  c->next_turn = 0;
-  heap_insert(&world.cur_map->turn, c);
-  world.cur_map->cmap[pos[dim_y]][pos[dim_x]] = c;
 }
 
 void new_char_other()
@@ -731,17 +756,16 @@ void new_char_other()
   pair_t pos;
   npc *c;
 
+  pathfind_update();
+
   do {
     rand_pos(pos);
-  } while (world.rival_dist[pos[dim_y]][pos[dim_x]] == INT_MAX ||
-           world.rival_dist[pos[dim_y]][pos[dim_x]] < 0        ||
-           world.cur_map->cmap[pos[dim_y]][pos[dim_x]]         ||
-           pos[dim_x] < 3 || pos[dim_x] > MAP_X - 4            ||
+  } while (world.rival_dist[pos[dim_y]][pos[dim_x]] == DIST_UNREACHABLE ||
+           world.cur_map->cmap[pos[dim_y]][pos[dim_x]]                  ||
+           pos[dim_x] < 3 || pos[dim_x] > MAP_X - 4                     ||
            pos[dim_y] < 3 || pos[dim_y] > MAP_Y - 4);
 
-  world.cur_map->cmap[pos[dim_y]][pos[dim_x]] = c = new npc;
-  c->pos[dim_y] = pos[dim_y];
-  c->pos[dim_x] = pos[dim_x];
+  c = new_npc(pos);
   c->ctype = char_other;
   switch (rand() % 4) {
   case 0:
@@ -762,15 +786,12 @@ void new_char_other()
     break;
   }
   rand_dir(c->dir);
-  c->defeated = 0;
-  c->next_turn = 0;
-  heap_insert(&world.cur_map->turn, c);
-  world.cur_map->cmap[pos[dim_y]][pos[dim_x]] = c;
 }
 
 void place_characters()
 {
-  world.cur_map->num_trainers = 2;
+  int32_t i;
+  TRACE_SCOPE("place_characters", "map");
 
   //Always place a hiker and a rival, then place a random number of others
   new_hiker();
@@ -792,8 +813,15 @@ void place_characters()
      * roll fails, but if the map is full (or almost full), it's         *
      * impossible (or very difficult) to continue to add, so we abort if *
      * we've tried MAX_TRAINER_TRIES times.                              */
-  } while (++world.cur_map->num_trainers < MIN_TRAINERS ||
+  } while (world.cur_map->num_trainers < MIN_TRAINERS ||
            ((rand() % 100) < ADD_TRAINER_PROB));
+
+  /* In the order they were made, which is the order they move in */
+  for (i = 0; i < world.cur_map->num_trainers; i++) {
+    if (!turn_park(world.cur_map, world.cur_map->npcs + i)) {
+      world.cur_map->turn.insert(world.cur_map->npcs + i);
+    }
+  }
 }
 
 void init_pc()
@@ -808,11 +836,13 @@ void init_pc()
   world.pc.pos[dim_x] = x;
   world.pc.pos[dim_y] = y;
   world.pc.symbol = '@';
+  world.pc.ctype = char_pc;
+  world.pc.mtype = move_pc;
 
-  world.cur_map->cmap[y][x] = &world.pc;
+  world.cur_map->cmap[y][x] = CMAP_PC;
   world.pc.next_turn = 0;
 
-  heap_insert(&world.cur_map->turn, &world.pc);
+  world.cur_map->turn.insert(&world.pc);
 }
 
 void place_pc()
@@ -829,9 +859,9 @@ void place_pc()
     world.pc.pos[dim_y] = 1;
   }
 
-  world.cur_map->cmap[world.pc.pos[dim_y]][world.pc.pos[dim_x]] = &world.pc;
+  world.cur_map->cmap[world.pc.pos[dim_y]][world.pc.pos[dim_x]] = CMAP_PC;
 
-  if ((c = (character *) heap_peek_min(&world.cur_map->turn))) {
+  if ((c = world.cur_map->turn.peek_min())) {
     world.pc.next_turn = c->next_turn;
   } else {
     world.pc.next_turn = 0;
@@ -853,6 +883,9 @@ int new_map(int teleport)
 
     return 0;
   }
+  /* Only maps that are made here */
+  PROF_SCOPE(prof_new_map);
+  TRACE_SCOPE("new_map", "map");
 
   world.cur_map                                             =
     world.world[world.cur_idx[dim_y]][world.cur_idx[dim_x]] =
@@ -904,14 +937,19 @@ int new_map(int teleport)
   if ((rand() % 100) < p || !d) {
     place_center(world.cur_map);
   }
+  map_path_costs(world.cur_map);
 
   for (y = 0; y < MAP_Y; y++) {
     for (x = 0; x < MAP_X; x++) {
-      world.cur_map->cmap[y][x] = NULL;
+      world.cur_map->cmap[y][x] = CMAP_NONE;
     }
   }
+  world.cur_map->npcs = NULL;
+  world.cur_map->party = NULL;
+  world.cur_map->num_trainers = world.cur_map->max_trainers = 0;
+  world.cur_map->num_parked = 0;
 
-  heap_init(&world.cur_map->turn, cmp_char_turns, delete_character);
+  world.cur_map->turn.init();
 
   if ((world.cur_idx[dim_x] == WORLD_SIZE / 2) &&
       (world.cur_idx[dim_y] == WORLD_SIZE / 2)) {
@@ -922,18 +960,17 @@ int new_map(int teleport)
 
   if (teleport) {
     do {
-      world.cur_map->cmap[world.pc.pos[dim_y]][world.pc.pos[dim_x]] = NULL;
+      world.cur_map->cmap[world.pc.pos[dim_y]][world.pc.pos[dim_x]] = CMAP_NONE;
       world.pc.pos[dim_x] = rand_range(1, MAP_X - 2);
       world.pc.pos[dim_y] = rand_range(1, MAP_Y - 2);
     } while (world.cur_map->cmap[world.pc.pos[dim_y]][world.pc.pos[dim_x]] ||
              (move_cost[char_pc][world.cur_map->map[world.pc.pos[dim_y]]
                                                    [world.pc.pos[dim_x]]] ==
-              INT_MAX)                                                      ||
-             world.rival_dist[world.pc.pos[dim_y]][world.pc.pos[dim_x]] < 0);
-    world.cur_map->cmap[world.pc.pos[dim_y]][world.pc.pos[dim_x]] = &world.pc;
+              INT_MAX));
+    world.cur_map->cmap[world.pc.pos[dim_y]][world.pc.pos[dim_x]] = CMAP_PC;
   }
 
-  pathfind(world.cur_map);
+  pathfind_dirty(world.cur_map);
   
   place_characters();
 
@@ -953,7 +990,7 @@ static void print_map()
   for (y = 0; y < MAP_Y; y++) {
     for (x = 0; x < MAP_X; x++) {
       if (world.cur_map->cmap[y][x]) {
-        putchar(world.cur_map->cmap[y][x]->symbol);
+        putchar(cmap_char(world.cur_map, world.cur_map->cmap[y][x])->symbol);
       } else {
         switch (world.cur_map->map[y][x]) {
         case ter_boulder:
@@ -1006,27 +1043,29 @@ void delete_world()
 {
   int x, y;
 
-  //Only correct because current game never leaves the initial map
-  //Need to iterate over all maps in 1.05+
-  heap_delete(&world.cur_map->turn);
-
   for (y = 0; y < WORLD_SIZE; y++) {
     for (x = 0; x < WORLD_SIZE; x++) {
       if (world.world[y][x]) {
+        world.world[y][x]->turn.destroy();
+        free(world.world[y][x]->npcs);
+        free(world.world[y][x]->party);
         free(world.world[y][x]);
         world.world[y][x] = NULL;
       }
     }
   }
+  pathfind_reset();
 }
 
 void print_hiker_dist()
 {
   int x, y;
 
+  pathfind_update();
+
   for (y = 0; y < MAP_Y; y++) {
     for (x = 0; x < MAP_X; x++) {
-      if (world.hiker_dist[y][x] == INT_MAX) {
+      if (world.hiker_dist[y][x] == DIST_UNREACHABLE) {
         printf("   ");
       } else {
         printf(" %5d", world.hiker_dist[y][x]);
@@ -1040,9 +1079,11 @@ void print_rival_dist()
 {
   int x, y;
 
+  pathfind_update();
+
   for (y = 0; y < MAP_Y; y++) {
     for (x = 0; x < MAP_X; x++) {
-      if (world.rival_dist[y][x] == INT_MAX || world.rival_dist[y][x] < 0) {
+      if (world.rival_dist[y][x] == DIST_UNREACHABLE) {
         printf("   ");
       } else {
         printf(" %02d", world.rival_dist[y][x] % 100);
@@ -1054,6 +1095,14 @@ void print_rival_dist()
 
 void leave_map(pair_t d)
 {
+  /* place_pc() works from the cell the PC left by, which has to be the *
+   * one beside the exit, even when the PC stepped onto it diagonally;  *
+   * anywhere else can be walled in on the next map.                    */
+  world.pc.pos[dim_x] = d[dim_x] < 1 ? 1 : (d[dim_x] > MAP_X - 2 ? MAP_X - 2 :
+                                            d[dim_x]);
+  world.pc.pos[dim_y] = d[dim_y] < 1 ? 1 : (d[dim_y] > MAP_Y - 2 ? MAP_Y - 2 :
+                                            d[dim_y]);
+
   if (d[dim_x] == 0) {
     world.cur_idx[dim_x]--;
   } else if (d[dim_y] == 0) {
@@ -1073,41 +1122,83 @@ void game_loop()
   bool is_pc;
 
   while (!world.quit) {
-    c = (character *) heap_remove_min(&world.cur_map->turn);
-    is_pc = dynamic_cast<npc *>(c) == NULL;
+    PROF_SCOPE(prof_game_loop);
+    TRACE_SCOPE("turn", "turn");
 
-    move_func[is_pc ? move_pc : ((npc *) c)->mtype](c, d);
+    c = world.cur_map->turn.remove_min();
+    is_pc = c->ctype == char_pc;
+    game_turns++;
+
+    {
+      /* Ended by name at the brace: a battle can change c->mtype */
+      TRACE_SCOPE(movement_type_name[c->mtype], "move");
+      move_func[c->mtype](c, d);
+    }
 
-    world.cur_map->cmap[c->pos[dim_y]][c->pos[dim_x]] = NULL;
+    world.cur_map->cmap[c->pos[dim_y]][c->pos[dim_x]] = CMAP_NONE;
     if (is_pc && (d[dim_x] == 0 || d[dim_x] == MAP_X - 1 ||
                   d[dim_y] == 0 || d[dim_y] == MAP_Y - 1)) {
       leave_map(d);
       d[dim_x] = c->pos[dim_x];
       d[dim_y] = c->pos[dim_y];
     }
-    world.cur_map->cmap[d[dim_y]][d[dim_x]] = c;
+    world.cur_map->cmap[d[dim_y]][d[dim_x]] = cmap_handle(world.cur_map, c);
 
     if (is_pc) {
-      pathfind(world.cur_map);
+      pathfind_dirty(world.cur_map);
+      turn_wake(world.cur_map, d, c->next_turn);
     }
 
-    c->next_turn += move_cost[is_pc ? char_pc : ((npc *) c)->ctype]
-                             [world.cur_map->map[d[dim_y]][d[dim_x]]];
+    c->next_turn += move_cost[c->ctype][world.cur_map->map[d[dim_y]][d[dim_x]]];
 
     c->pos[dim_y] = d[dim_y];
     c->pos[dim_x] = d[dim_x];
+    journal_turn(c);
 
-    heap_insert(&world.cur_map->turn, c);
+    if (!turn_park(world.cur_map, c)) {
+      world.cur_map->turn.insert(c);
+    }
   }
 }
 
 void usage(char *s)
 {
-  fprintf(stderr, "Usage: %s [-s|--seed <seed>]\n", s);
+  fprintf(stderr, "Usage: %s [-s|--seed <seed>] "
+          "[-v|--version-group <ids>|all] [-m|--move-method <ids>|all] "
+          "[-l|--load-threads <n>]\n"
+          "       [-h|--headless random|explore|<script> [-t|--turns <n>]]\n"
+          "       [-r|--record <journal>] [-R|--replay <journal>] "
+          "[-T|--trace <file>]\n",
+          s);
 
   exit(1);
 }
 
+/* Parses a comma-separated list of small ids, or "all", into a bitmask. */
+static int parse_id_mask(const char *s, uint32_t *mask)
+{
+  int id, n;
+
+  if (!strcmp(s, "all")) {
+    *mask = DB_ALL;
+    return 0;
+  }
+
+  for (*mask = 0; *s; s += n) {
+    if (sscanf(s, "%d%n", &id, &n) != 1 || id < 0 || id > 31) {
+      return 1;
+    }
+    *mask |= 1u << id;
+    if (s[n] == ',') {
+      n++;
+    } else if (s[n]) {
+      return 1;
+    }
+  }
+
+  return !*mask;
+}
+
 
 
 int main(int argc, char *argv[])
@@ -1116,13 +1207,20 @@ int main(int argc, char *argv[])
   uint32_t seed;
   int long_arg;
   int do_seed;
+  const char *headless_how;
+  const char *record, *replay;
+  const char *trace;
+  uint32_t max_turns;
+  int rc;
   //  char c;
   //  int x, y;
   int i;
 
-  db_parse(false);
-
   do_seed = 1;
+  headless_how = NULL;
+  record = replay = NULL;
+  trace = NULL;
+  max_turns = 0;
   
   if (argc > 1) {
     for (i = 1, long_arg = 0; i < argc; i++, long_arg = 0) {
@@ -1141,6 +1239,77 @@ int main(int argc, char *argv[])
           }
           do_seed = 0;
           break;
+        case 'v':
+          if ((!long_arg && argv[i][2]) ||
+              (long_arg && strcmp(argv[i], "-version-group")) ||
+              argc < ++i + 1 /* No more arguments */ ||
+              parse_id_mask(argv[i], &db_version_groups)) {
+            usage(argv[0]);
+          }
+          break;
+        case 'm':
+          if ((!long_arg && argv[i][2]) ||
+              (long_arg && strcmp(argv[i], "-move-method")) ||
+              argc < ++i + 1 /* No more arguments */ ||
+              parse_id_mask(argv[i], &db_move_methods)) {
+            usage(argv[0]);
+          }
+          break;
+        case 'l':
+          if ((!long_arg && argv[i][2]) ||
+              (long_arg && strcmp(argv[i], "-load-threads")) ||
+              argc < ++i + 1 /* No more arguments */ ||
+              !sscanf(argv[i], "%d", &db_load_threads) ||
+              db_load_threads < 0) {
+            usage(argv[0]);
+          }
+          break;
+        case 'h':
+          if ((!long_arg && argv[i][2]) ||
+              (long_arg && strcmp(argv[i], "-headless")) ||
+              argc < ++i + 1 /* No more arguments */) {
+            usage(argv[0]);
+          }
+          headless_how = argv[i];
+          break;
+        case 'r':
+          if ((!long_arg && argv[i][2]) ||
+              (long_arg && strcmp(argv[i], "-record") &&
+               strcmp(argv[i], "-replay")) ||
+              argc < ++i + 1 /* No more arguments */) {
+            usage(argv[0]);
+          }
+          if (long_arg && !strcmp(argv[i - 1], "-replay")) {
+            replay = argv[i];
+          } else {
+            record = argv[i];
+          }
+          break;
+        case 'R':
+          if (long_arg || argv[i][2] || argc < ++i + 1) {
+            usage(argv[0]);
+          }
+          replay = argv[i];
+          break;
+        case 't':
+          if ((!long_arg && argv[i][2]) ||
+              (long_arg && strcmp(argv[i], "-turns") &&
+               strcmp(argv[i], "-trace")) ||
+              argc < ++i + 1 /* No more arguments */) {
+            usage(argv[0]);
+          }
+          if (long_arg && !strcmp(argv[i - 1], "-trace")) {
+            trace = argv[i];
+          } else if (!sscanf(argv[i], "%u", &max_turns)) {
+            usage(argv[0]);
+          }
+          break;
+        case 'T':
+          if (long_arg || argv[i][2] || argc < ++i + 1) {
+            usage(argv[0]);
+          }
+          trace = argv[i];
+          break;
         default:
           usage(argv[0]);
         }
@@ -1150,6 +1319,28 @@ int main(int argc, char *argv[])
     }
   }
 
+  /* A journal is played with no terminal, and a policy presses no keys */
+  if ((replay && (record || headless_how)) || (record && headless_how)) {
+    usage(argv[0]);
+  }
+
+  /* The journal has the seed and the filters the pokedex loads with */
+  if (replay) {
+    if (journal_replay(replay, &seed)) {
+      usage(argv[0]);
+    }
+    do_seed = 0;
+  }
+
+  /* Started before the pokedex load, so the timeline has all of it */
+  if (trace && trace_start(trace)) {
+    usage(argv[0]);
+  }
+
+  /* Nothing before the first create_pokemon() needs the pokedex, so it *
+   * loads while the terminal comes up and the first map is built.      */
+  db_parse_async();
+
   if (do_seed) {
     /* Allows me to start the game more than once *
      * per second, as opposed to time().          */
@@ -1162,20 +1353,48 @@ int main(int argc, char *argv[])
   printf("Using seed: %u\n", seed);
   srand(seed);
 
-  io_init_terminal();
+  if (record && journal_record(record, seed)) {
+    usage(argv[0]);
+  }
+
+  if (headless_how && headless_init(headless_how, max_turns)) {
+    usage(argv[0]);
+  }
+
+  if (!headless && !journal_replaying) {
+    io_init_terminal();
+  }
   
   init_world();
 
-  select_pokemon();
+  if (headless) {
+    world.pokemon_pc[0] = create_pokemon();
+  } else {
+    select_pokemon();
+  }
   world.balls = 10;
   world.potions = 2;
   world. revives = 2;
 
   game_loop();
-  
-  delete_world();
 
-  io_reset_terminal();
+  if (!headless && !journal_replaying) {
+    io_reset_terminal();
+  }
+
+  db_print_load_times(stdout);
+  pathfind_print_stats(stdout);
+  turn_print_stats(stdout);
+  if (headless) {
+    headless_print_stats(stdout);
+  }
+  rc = journal_close(stdout);
+  prof_write(PROF_FILE);
+  /* The loader traces too, and must be done before its events are read */
+  db_wait();
+  trace_write();
+
+  delete_world();
   
-  return 0;
+  return rc;
 }
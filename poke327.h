@@ -1,10 +1,12 @@
 #ifndef POKE327_H
 # define POKE327_H
 
+# include <stdio.h>
 # include <stdlib.h>
 # include <assert.h>
 
-# include "heap.h"
+# include "pqueue.h"
+# include "wheel.h"
 
 # include "pair.h"
 # include "io.h"
@@ -67,21 +69,26 @@ typedef enum __attribute__ ((__packed__)) character_type {
   num_character_types
 } character_type_t;
 
+/* No virtual functions: ctype says what a character is, char_pc for *
+ * the PC and an npc otherwise, and mtype picks its move_func, so the  *
+ * turn loop never needs RTTI.  Only what moving and scheduling touch  *
+ * lives here; parties are kept apart, see char_party().               */
 class character {
  public:
-  virtual ~character() {};
-
   pair_t pos;
   char symbol;
+  character_type_t ctype;
+  movement_type_t mtype;
   int next_turn;
-  pokemon_t pokemon_char[6];
+  character *turn_next;
 };
 
+/* NPCs are not allocated one at a time: each map keeps its own in one *
+ * array, map_t::npcs, which is only resized while the map is made.    */
 class npc : public character {
  public:
-  character_type_t ctype;
-  movement_type_t mtype;
   int defeated;
+  int parked;      /* Out of the turn queue; see turn_park() */
   pair_t dir;
 };
 
@@ -91,8 +98,20 @@ class pc : public character {
 /* character is defined in poke327.h to allow an instance of character
  * in world without including character.h in poke327.h                 */
 
-int32_t cmp_char_turns(const void *key, const void *with);
-void delete_character(void *v);
+struct turn_key {
+  int32_t operator()(const character *c) const
+  {
+    return c->next_turn;
+  }
+};
+
+/* Turns advance by move_cost, never more than 50, so they nearly all  *
+ * land inside one turn of the wheel.  Characters due on the same      *
+ * turn move first in, first out, which is not the order heap.c gave   *
+ * them, so a seed no longer plays out as it did before the wheel.     *
+ * It still plays out the same every time; a --record journal checks   *
+ * that with a hash of the world after every PC turn (journal.h).     */
+typedef wheel<character, turn_key, &character::turn_next> turn_queue_t;
 
 int pc_move(char);
 
@@ -100,17 +119,41 @@ extern const char *char_type_name[num_character_types];
 
 extern int32_t move_cost[num_character_types][num_terrain_types];
 
+/* path_cost entry for cells a character type can't path through */
+#define PATH_IMPASSABLE UINT8_MAX
+
+/* Distances in world.hiker_dist and world.rival_dist.  Real ones are *
+ * far smaller, but anything longer saturates at DIST_MAX rather than *
+ * wrapping, so DIST_UNREACHABLE only ever means unreachable.         */
+#define DIST_UNREACHABLE UINT16_MAX
+#define DIST_MAX         (UINT16_MAX - 1)
+
 typedef struct map {
   terrain_type_t map[MAP_Y][MAP_X];
   uint8_t height[MAP_Y][MAP_X];
-  character *cmap[MAP_Y][MAP_X];
-  heap_t turn;
+  uint8_t path_cost[num_character_types][MAP_Y][MAP_X];
+  uint16_t cmap[MAP_Y][MAP_X];
+  turn_queue_t turn;
+  npc *npcs;               /* num_trainers of them  */
+  pokemon_t (*party)[6];   /* party[i] is npcs[i]'s */
   int32_t num_trainers;
+  int32_t max_trainers;    /* Room in npcs, party   */
+  int32_t num_parked;      /* Of the npcs           */
   int8_t n, s, e, w;
 } map_t;
 
+void map_path_costs(map_t *m);
 void pathfind(map_t *m);
+void pathfind_dirty(map_t *m);
+void pathfind_update();
+void pathfind_reset();
+void pathfind_print_stats(FILE *f);
+bool turn_park(map_t *m, character *c);
+void turn_wake(map_t *m, pair_t at, int32_t when);
+void turn_print_stats(FILE *f);
 extern void (*move_func[num_movement_types])(character *, pair_t);
+/* Names move_func's entries in a --trace */
+extern const char *movement_type_name[num_movement_types];
 
 typedef struct world {
   map_t *world[WORLD_SIZE][WORLD_SIZE];
@@ -118,8 +161,11 @@ typedef struct world {
   map_t *cur_map;
   /* Please distance maps in world, not map, since *
    * we only need one pair at any given time.      */
-  int hiker_dist[MAP_Y][MAP_X];
-  int rival_dist[MAP_Y][MAP_X];
+  uint16_t hiker_dist[MAP_Y][MAP_X];
+  uint16_t rival_dist[MAP_Y][MAP_X];
+  /* Best next directions, a bit per all_dirs entry; see pathfind_update() */
+  uint8_t hiker_flow[MAP_Y][MAP_X];
+  uint8_t rival_flow[MAP_Y][MAP_X];
   class pc pc;
   pokemon_t pokemon_pc[6];
   int potions;
@@ -133,6 +179,27 @@ typedef struct world {
  * large thing to put on the stack.  To avoid that, world is a global.     */
 extern world_t world;
 
+/* What a map_t::cmap cell holds: CMAP_NONE, CMAP_PC, or CMAP_NPC + i *
+ * for the map's npcs[i].  Being small integers, the whole cmap is a   *
+ * few kilobytes and says nothing about where characters live.        */
+#define CMAP_NONE 0
+#define CMAP_PC   1
+#define CMAP_NPC  2
+
+static inline character *cmap_char(map_t *m, uint16_t h)
+{
+  return (h == CMAP_PC ? (character *) &world.pc :
+          h ? (character *) (m->npcs + h - CMAP_NPC) : NULL);
+}
+
+static inline uint16_t cmap_handle(map_t *m, character *c)
+{
+  return c->ctype == char_pc ? CMAP_PC : ((npc *) c - m->npcs) + CMAP_NPC;
+}
+
+/* A character's six pokemon.  NPCs must be on the current map. */
+pokemon_t *char_party(character *c);
+
 extern pair_t all_dirs[8];
 
 #define rand_dir(dir) {     \
@@ -142,12 +209,31 @@ extern pair_t all_dirs[8];
 }
 
 typedef struct path {
-  heap_node_t *hn;
+  pqueue_node<struct path> node;
   uint8_t pos[2];
   uint8_t from[2];
   int32_t cost;
 } path_t;
 
+struct path_compare {
+  int32_t operator()(const path_t *key, const path_t *with) const
+  {
+    return key->cost - with->cost;
+  }
+};
+
+typedef pqueue<path_t, path_compare, &path_t::node> path_queue_t;
+
 int new_map(int teleport);
+/* new_map()'s costliest steps, in the order it takes them; bench times *
+ * them one at a time.                                                 */
+int smooth_height(map_t *m);
+int map_terrain(map_t *m, int8_t n, int8_t s, int8_t e, int8_t w);
+int build_paths(map_t *m);
+void init_world();
+void delete_world();
+void game_loop();
+/* Turns game_loop() has run, the PC's and NPCs' alike */
+extern uint64_t game_turns;
 
 #endif
@@ -0,0 +1,210 @@
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <climits>
+#include <cstdarg>
+
+#include "db_parse.h"
+
+/* Turns the pokedex CSV files into pokedex_data.cpp, which defines every *
+ * table and index global as a pointer into a constexpr array.  Linking   *
+ * that with db_parse built with -DPOKEDEX_STATIC gives a binary that     *
+ * never reads the pokedex at runtime; see "make static".                 *
+ *                                                                        *
+ * Usage: pokedex_gen <csv dir/> > pokedex_data.cpp                       */
+
+static void put_int(int i)
+{
+  if (i == INT_MAX) {
+    fputs("INT_MAX", stdout);
+  } else {
+    printf("%d", i);
+  }
+}
+
+static void put_str(const char *s)
+{
+  putchar('"');
+  for (; s && *s; s++) {
+    if (*s == '"' || *s == '\\') {
+      putchar('\\');
+    }
+    putchar(*s);
+  }
+  putchar('"');
+}
+
+/* One initializer row: { a, b, ... }, with strings wherever the format *
+ * has an 's' and ints wherever it has an 'i'.                          */
+static void put_row(const char *format, ...)
+{
+  va_list ap;
+  const char *f;
+
+  va_start(ap, format);
+  fputs("  { ", stdout);
+  for (f = format; *f; f++) {
+    if (f != format) {
+      fputs(", ", stdout);
+    }
+    if (*f == 's') {
+      put_str(va_arg(ap, const char *));
+    } else {
+      put_int(va_arg(ap, int));
+    }
+  }
+  fputs(" },\n", stdout);
+  va_end(ap);
+}
+
+static void put_ints(const char *name, const int *v, int n)
+{
+  int i;
+
+  printf("static constexpr int %s[%d] = {", name, n);
+  for (i = 0; i < n; i++) {
+    fputs(i % 12 ? " " : "\n  ", stdout);
+    put_int(v[i]);
+    putchar(',');
+  }
+  fputs("\n};\n\n", stdout);
+}
+
+int main(int argc, char *argv[])
+{
+  int i;
+
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s <csv dir/>\n", argv[0]);
+    return 1;
+  }
+
+  db_load_threads = 1;
+  db_parse_csv(argv[1], true);
+
+  printf("/* Generated by pokedex_gen from %s; do not edit. */\n\n"
+         "#include <climits>\n\n"
+         "#include \"db_parse.h\"\n\n", argv[1]);
+
+  printf("extern const uint32_t pokedex_version_groups = %uu;\n"
+         "extern const uint32_t pokedex_move_methods = %uu;\n\n",
+         db_version_groups, db_move_methods);
+
+  printf("static constexpr pokemon_db pokedex_pokemon[NUM_POKEMON] = {\n");
+  for (i = 0; i < NUM_POKEMON; i++) {
+    put_row("isiiiiii", pokemon[i].id, pokemon[i].identifier,
+            pokemon[i].species_id, pokemon[i].height, pokemon[i].weight,
+            pokemon[i].base_experience, pokemon[i].order,
+            pokemon[i].is_default);
+  }
+  printf("};\n\n");
+
+  printf("static constexpr move_db pokedex_moves[NUM_MOVES] = {\n");
+  for (i = 0; i < NUM_MOVES; i++) {
+    put_row("isiiiiiiiiiiiii", moves[i].id, moves[i].identifier,
+            moves[i].generation_id, moves[i].type_id, moves[i].power,
+            moves[i].pp, moves[i].accuracy, moves[i].priority,
+            moves[i].target_id, moves[i].damage_class_id, moves[i].effect_id,
+            moves[i].effect_chance, moves[i].contest_type_id,
+            moves[i].contest_effect_id, moves[i].super_contest_effect_id);
+  }
+  printf("};\n\n");
+
+  /* No zero-length arrays, so an empty learnset still gets one dummy row */
+  printf("static constexpr pokemon_move_db pokedex_pokemon_moves[%d] = {\n",
+         num_pokemon_moves ? num_pokemon_moves : 1);
+  for (i = 0; i < num_pokemon_moves; i++) {
+    printf("  { %u, %u, %u, %u, %u, %u },\n", pokemon_moves[i].pokemon_id,
+           pokemon_moves[i].version_group_id, pokemon_moves[i].move_id,
+           pokemon_moves[i].pokemon_move_method_id, pokemon_moves[i].level,
+           pokemon_moves[i].order);
+  }
+  if (!num_pokemon_moves) {
+    printf("  { 0, 0, 0, 0, 0, 0 },\n");
+  }
+  printf("};\n\n");
+
+  printf("static constexpr pokemon_species_db pokedex_species[NUM_SPECIES] = "
+         "{\n");
+  for (i = 0; i < NUM_SPECIES; i++) {
+    put_row("isiiiiiiiiiiiiiiiiii", species[i].id, species[i].identifier,
+            species[i].generation_id, species[i].evolves_from_species_id,
+            species[i].evolution_chain_id, species[i].color_id,
+            species[i].shape_id, species[i].habitat_id,
+            species[i].gender_rate, species[i].capture_rate,
+            species[i].base_happiness, species[i].is_baby,
+            species[i].hatch_counter, species[i].has_gender_differences,
+            species[i].growth_rate_id, species[i].forms_switchable,
+            species[i].is_legendary, species[i].is_mythical,
+            species[i].order, species[i].conquest_order);
+  }
+  printf("};\n\n");
+
+  printf("static constexpr experience_db pokedex_experience[NUM_EXPERIENCE] = "
+         "{\n");
+  for (i = 0; i < NUM_EXPERIENCE; i++) {
+    put_row("iii", experience[i].growth_rate_id, experience[i].level,
+            experience[i].experience);
+  }
+  printf("};\n\n");
+
+  printf("static constexpr pokemon_stats_db "
+         "pokedex_pokemon_stats[NUM_POKEMON_STATS] = {\n");
+  for (i = 0; i < NUM_POKEMON_STATS; i++) {
+    put_row("iiii", pokemon_stats[i].pokemon_id, pokemon_stats[i].stat_id,
+            pokemon_stats[i].base_stat, pokemon_stats[i].effort);
+  }
+  printf("};\n\n");
+
+  printf("static constexpr stats_db pokedex_stats[NUM_STATS] = {\n");
+  for (i = 0; i < NUM_STATS; i++) {
+    put_row("iisii", stats[i].id, stats[i].damage_class_id,
+            stats[i].identifier, stats[i].is_battle_only,
+            stats[i].game_index);
+  }
+  printf("};\n\n");
+
+  printf("static constexpr pokemon_types_db "
+         "pokedex_pokemon_types[NUM_POKEMON_TYPES] = {\n");
+  for (i = 0; i < NUM_POKEMON_TYPES; i++) {
+    put_row("iii", pokemon_types[i].pokemon_id, pokemon_types[i].type_id,
+            pokemon_types[i].slot);
+  }
+  printf("};\n\n");
+
+  put_ints("pokedex_learnset_offset", learnset_offset, NUM_SPECIES + 1);
+  put_ints("pokedex_move_index", move_index, num_move_ids);
+
+  printf("static constexpr int pokedex_base_stats[NUM_SPECIES][6] = {\n");
+  for (i = 0; i < NUM_SPECIES; i++) {
+    put_row("iiiiii", species_base_stats[i][0], species_base_stats[i][1],
+            species_base_stats[i][2], species_base_stats[i][3],
+            species_base_stats[i][4], species_base_stats[i][5]);
+  }
+  printf("};\n\n");
+
+  printf("const pokemon_move_db *pokemon_moves = pokedex_pokemon_moves;\n"
+         "int num_pokemon_moves = %d;\n"
+         "const pokemon_db *pokemon = pokedex_pokemon;\n"
+         "const move_db *moves = pokedex_moves;\n"
+         "const pokemon_species_db *species = pokedex_species;\n"
+         "const experience_db *experience = pokedex_experience;\n"
+         "const pokemon_stats_db *pokemon_stats = pokedex_pokemon_stats;\n"
+         "const stats_db *stats = pokedex_stats;\n"
+         "const pokemon_types_db *pokemon_types = pokedex_pokemon_types;\n"
+         "const int *learnset_offset = pokedex_learnset_offset;\n"
+         "const int *move_index = pokedex_move_index;\n"
+         "int num_move_ids = %d;\n"
+         "const int (*species_base_stats)[6] = pokedex_base_stats;\n\n",
+         num_pokemon_moves, num_move_ids);
+
+  printf("const char *types[NUM_TYPES] = {\n  NULL,\n");
+  for (i = 1; i < NUM_TYPES; i++) {
+    fputs("  ", stdout);
+    put_str(types[i]);
+    fputs(",\n", stdout);
+  }
+  printf("};\n");
+
+  return 0;
+}
@@ -0,0 +1,279 @@
+#ifndef PQUEUE_H
+# define PQUEUE_H
+
+# include <stdint.h>
+# include <string.h>
+
+# ifdef HEAP_TRACE
+#  include "heap.h"
+# endif
+
+/* The links a pqueue keeps in each of its elements */
+template <class T>
+struct pqueue_node {
+  T *next;
+  T *prev;
+  T *parent;
+  T *child;
+  uint32_t degree;
+  uint16_t mark;
+  uint16_t queued;  /* Set from insert() until remove_min() or destroy() */
+};
+
+/* heap.h for C++ callers.  A pqueue is heap.c's Fibonacci heap, step   *
+ * for step, over T * ordered by Compare, a functor that takes two      *
+ * const T * and returns less than, equal to or greater than zero like  *
+ * a heap.h compare.  The compare is a template argument, so it is      *
+ * inlined rather than called through a pointer, and the nodes are the  *
+ * pqueue_node member of T that Node points to, so nothing is           *
+ * allocated.                                                           *
+ *                                                                      *
+ * Doing exactly what heap.c does keeps its tie order: equal keys come  *
+ * out in the same order they did from a heap_t, so a seed still lays   *
+ * the same roads.  Like heap_t this is plain data, fine in a           *
+ * malloc()ed struct; init() it before use.  destroy() unlinks whatever *
+ * is still queued but doesn't free it.                                */
+template <class T, class Compare, pqueue_node<T> T::*Node>
+struct pqueue {
+  T *min;
+  uint32_t size;
+
+# ifdef HEAP_TRACE
+  /* The heap_trace of pqueues, one per instantiation */
+  static void (*trace)(pqueue *q, heap_op_t op, T *t);
+# endif
+
+  void init()
+  {
+    min = NULL;
+    size = 0;
+# ifdef HEAP_TRACE
+    if (trace) {
+      trace(this, heap_op_init, NULL);
+    }
+# endif
+  }
+
+  void destroy()
+  {
+# ifdef HEAP_TRACE
+    if (trace) {
+      trace(this, heap_op_delete, NULL);
+    }
+# endif
+    if (min) {
+      forget(min);
+    }
+    min = NULL;
+    size = 0;
+  }
+
+  static bool queued(const T *t)
+  {
+    return (t->*Node).queued;
+  }
+
+  T *peek_min() const
+  {
+    return min;
+  }
+
+  void insert(T *t)
+  {
+    memset(&(t->*Node), 0, sizeof (t->*Node));
+    (t->*Node).queued = 1;
+
+    if (min) {
+      insert_in_list(t, min);
+    } else {
+      (t->*Node).next = (t->*Node).prev = t;
+    }
+    if (!min || Compare()(t, min) < 0) {
+      min = t;
+    }
+    size++;
+# ifdef HEAP_TRACE
+    if (trace) {
+      trace(this, heap_op_insert, t);
+    }
+# endif
+  }
+
+  T *remove_min()
+  {
+    T *t, *n;
+
+    if (!(t = min)) {
+      return NULL;
+    }
+    if (size == 1) {
+      min = NULL;
+    } else {
+      if ((n = (t->*Node).child)) {
+        for (; (n->*Node).parent; n = (n->*Node).next) {
+          (n->*Node).parent = NULL;
+        }
+      }
+
+      splice_lists(t, (t->*Node).child);
+
+      remove_from_list(t);
+      min = (t->*Node).next;
+
+      consolidate();
+    }
+    size--;
+    (t->*Node).queued = 0;
+# ifdef HEAP_TRACE
+    if (trace) {
+      trace(this, heap_op_remove_min, t);
+    }
+# endif
+
+    return t;
+  }
+
+  /* t's key has gone down; t must be queued.  heap.c's               *
+   * heap_decrease_key_no_replace(), down to its cascading cut, which *
+   * stops after the parent.                                          */
+  void decrease_key(T *t)
+  {
+    T *p;
+
+    p = (t->*Node).parent;
+
+    if (p && Compare()(t, p) < 0) {
+      cut(t, p);
+      if ((p->*Node).parent) {
+        if (!(p->*Node).mark) {
+          (p->*Node).mark = 1;
+        } else {
+          cut(p, (p->*Node).parent);
+        }
+      }
+    }
+    if (Compare()(t, min) < 0) {
+      min = t;
+    }
+# ifdef HEAP_TRACE
+    if (trace) {
+      trace(this, heap_op_decrease_key, t);
+    }
+# endif
+  }
+
+ private:
+  static void insert_in_list(T *t, T *l)
+  {
+    (t->*Node).next = l;
+    (t->*Node).prev = (l->*Node).prev;
+    ((t->*Node).prev->*Node).next = t;
+    (l->*Node).prev = t;
+  }
+
+  static void remove_from_list(T *t)
+  {
+    ((t->*Node).next->*Node).prev = (t->*Node).prev;
+    ((t->*Node).prev->*Node).next = (t->*Node).next;
+  }
+
+  static void splice_lists(T *a, T *b)
+  {
+    if (a && b) {
+      ((a->*Node).next->*Node).prev = (b->*Node).prev;
+      ((b->*Node).prev->*Node).next = (a->*Node).next;
+      (a->*Node).next = b;
+      (b->*Node).prev = a;
+    }
+  }
+
+  static void link(T *t, T *root)
+  {
+    if ((root->*Node).child) {
+      insert_in_list(t, (root->*Node).child);
+    } else {
+      (root->*Node).child = t;
+      (t->*Node).next = (t->*Node).prev = t;
+    }
+    (t->*Node).parent = root;
+    (root->*Node).degree++;
+    (t->*Node).mark = 0;
+  }
+
+  void consolidate()
+  {
+    uint32_t i;
+    T *x, *y, *n, *tmp;
+    T *a[64];
+
+    memset(a, 0, sizeof (a));
+
+    ((min->*Node).prev->*Node).next = NULL;
+
+    for (x = n = min; n; x = n) {
+      n = (n->*Node).next;
+
+      while (a[(x->*Node).degree]) {
+        y = a[(x->*Node).degree];
+        if (Compare()(x, y) > 0) {
+          tmp = x;
+          x = y;
+          y = tmp;
+        }
+        a[(x->*Node).degree] = NULL;
+        link(y, x);
+      }
+      a[(x->*Node).degree] = x;
+    }
+
+    for (min = NULL, i = 0; i < 64; i++) {
+      if (a[i]) {
+        if (min) {
+          insert_in_list(a[i], min);
+          if (Compare()(a[i], min) < 0) {
+            min = a[i];
+          }
+        } else {
+          min = a[i];
+          (a[i]->*Node).next = (a[i]->*Node).prev = a[i];
+        }
+      }
+    }
+  }
+
+  void cut(T *t, T *p)
+  {
+    if (!--(p->*Node).degree) {
+      (p->*Node).child = NULL;
+    }
+    if ((p->*Node).child == t) {
+      (p->*Node).child = ((p->*Node).child->*Node).next;
+    }
+    remove_from_list(t);
+    (t->*Node).parent = NULL;
+    (t->*Node).mark = 0;
+    insert_in_list(t, min);
+  }
+
+  /* Clears queued on t's list and everything under it */
+  static void forget(T *t)
+  {
+    T *n;
+
+    n = t;
+    do {
+      (n->*Node).queued = 0;
+      if ((n->*Node).child) {
+        forget((n->*Node).child);
+      }
+      n = (n->*Node).next;
+    } while (n != t);
+  }
+};
+
+# ifdef HEAP_TRACE
+template <class T, class Compare, pqueue_node<T> T::*Node>
+void (*pqueue<T, Compare, Node>::trace)(pqueue *q, heap_op_t op, T *t);
+# endif
+
+#endif
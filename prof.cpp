@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <string.h>
+#include <ncurses.h>
+
+#include "prof.h"
+
+int prof_overlay;
+
+#ifdef PROF
+
+uint64_t prof_waited;
+
+/* A log-linear histogram: exact below 16 ns, then 8 buckets to each   *
+ * power of two, so any bucket is within 12.5% of what fell in it.     *
+ * The last bucket takes everything from about 18 minutes up.          */
+# define PROF_EXACT   16
+# define PROF_SUB     8
+# define PROF_BUCKETS (PROF_EXACT + (40 - 4) * PROF_SUB)
+
+static const char *prof_name[num_prof_ids] = {
+  "new_map",
+  "pathfind",
+  "dijkstra_path",
+  "create_pokemon",
+  "init_pokemon_trainers",
+  "io_display",
+  "game_loop turn",
+};
+
+/* Short enough for four to a status line */
+static const char *prof_label[num_prof_ids] = {
+  "map", "path", "dijk", "poke", "party", "draw", "turn"
+};
+
+static struct {
+  uint64_t count;
+  uint64_t total;
+  uint64_t last;
+  uint64_t max;
+  uint32_t bucket[PROF_BUCKETS];
+} prof[num_prof_ids];
+
+static uint32_t prof_bucket(uint64_t ns)
+{
+  uint32_t e, b;
+
+  if (ns < PROF_EXACT) {
+    return ns;
+  }
+  e = 63 - __builtin_clzll(ns);
+  b = PROF_EXACT + (e - 4) * PROF_SUB + ((ns >> (e - 3)) & (PROF_SUB - 1));
+
+  return b < PROF_BUCKETS ? b : PROF_BUCKETS - 1;
+}
+
+/* The smallest time in bucket b */
+static uint64_t prof_bucket_low(uint32_t b)
+{
+  if (b < PROF_EXACT) {
+    return b;
+  }
+  b -= PROF_EXACT;
+
+  return (uint64_t) (PROF_SUB + b % PROF_SUB) << (b / PROF_SUB + 1);
+}
+
+void prof_add(prof_id_t id, uint64_t ns)
+{
+  prof[id].count++;
+  prof[id].total += ns;
+  prof[id].last = ns;
+  if (ns > prof[id].max) {
+    prof[id].max = ns;
+  }
+  prof[id].bucket[prof_bucket(ns)]++;
+}
+
+/* The top of the bucket the pth percentile falls in, so never low */
+static uint64_t prof_percentile(prof_id_t id, uint32_t p)
+{
+  uint64_t n, seen;
+  uint32_t b;
+
+  if (!prof[id].count) {
+    return 0;
+  }
+  /* Rank of the pth percentile, rounded up */
+  n = (prof[id].count * p + 99) / 100;
+  for (seen = 0, b = 0; b < PROF_BUCKETS - 1; b++) {
+    if ((seen += prof[id].bucket[b]) >= n) {
+      break;
+    }
+  }
+
+  if (b < PROF_BUCKETS - 1 && prof_bucket_low(b + 1) - 1 < prof[id].max) {
+    return prof_bucket_low(b + 1) - 1;
+  }
+
+  return prof[id].max;
+}
+
+/* Four characters: 999n, 1.2u, 999u, 1.2m and so on */
+static void prof_format(char *s, uint64_t ns)
+{
+  static const char unit[] = "num";
+  double v;
+  int i;
+
+  for (v = ns, i = 0; i < 3 && v >= 999.5; i++) {
+    v /= 1000;
+  }
+  if (i == 3) {
+    snprintf(s, 5, "%3.0fs", v > 999 ? 999 : v);
+  } else if (i && v < 9.95) {
+    snprintf(s, 5, "%.1f%c", v, unit[i]);
+  } else {
+    snprintf(s, 5, "%3.0f%c", v, unit[i]);
+  }
+}
+
+void prof_draw(int y)
+{
+  char last[5], mean[5], p99[5];
+  int i;
+
+  attron(COLOR_PAIR(COLOR_CYAN));
+  mvprintw(y, 0, "%-80s", "");
+  mvprintw(y + 1, 0, "%-80s", "last/mean/p99");
+  for (i = 0; i < num_prof_ids; i++) {
+    prof_format(last, prof[i].last);
+    prof_format(mean, prof[i].count ? prof[i].total / prof[i].count : 0);
+    prof_format(p99, prof_percentile((prof_id_t) i, 99));
+    mvprintw(y + i / 4, (i % 4) * 20 + (i / 4) * 20,
+             "%-5s%s/%s/%s", prof_label[i], last, mean, p99);
+  }
+  attroff(COLOR_PAIR(COLOR_CYAN));
+}
+
+int prof_write(const char *path)
+{
+  FILE *f;
+  uint32_t b;
+  int i;
+
+  if (!(f = fopen(path, "w"))) {
+    perror(path);
+    return -1;
+  }
+
+  fprintf(f, "%-22s %10s %10s %10s %10s %10s %10s\n", "timer (ns)", "count",
+          "mean", "p50", "p90", "p99", "max");
+  for (i = 0; i < num_prof_ids; i++) {
+    fprintf(f, "%-22s %10llu %10llu %10llu %10llu %10llu %10llu\n",
+            prof_name[i], (unsigned long long) prof[i].count,
+            (unsigned long long) (prof[i].count ?
+                                  prof[i].total / prof[i].count : 0),
+            (unsigned long long) prof_percentile((prof_id_t) i, 50),
+            (unsigned long long) prof_percentile((prof_id_t) i, 90),
+            (unsigned long long) prof_percentile((prof_id_t) i, 99),
+            (unsigned long long) prof[i].max);
+  }
+
+  for (i = 0; i < num_prof_ids; i++) {
+    fprintf(f, "\n%s: from (ns), count\n", prof_name[i]);
+    for (b = 0; b < PROF_BUCKETS; b++) {
+      if (prof[i].bucket[b]) {
+        fprintf(f, "  %12llu %10u\n",
+                (unsigned long long) prof_bucket_low(b), prof[i].bucket[b]);
+      }
+    }
+  }
+  fclose(f);
+
+  printf("Timings written to %s\n", path);
+
+  return 0;
+}
+
+#else
+
+void prof_draw(int y)
+{
+  attron(COLOR_PAIR(COLOR_CYAN));
+  mvprintw(y, 0, "%-80s", "Built without the timers; make clean, then "
+           "make PROF_FLAGS=-DPROF.");
+  mvprintw(y + 1, 0, "%-80s", "");
+  attroff(COLOR_PAIR(COLOR_CYAN));
+}
+
+int prof_write(const char *path)
+{
+  return 0;
+}
+
+#endif
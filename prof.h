@@ -0,0 +1,81 @@
+#ifndef PROF_H
+# define PROF_H
+
+# include <stdio.h>
+# include <stdint.h>
+# include <time.h>
+
+/* Timers on the hot paths, compiled in only with -DPROF ("make        *
+ * PROF_FLAGS=-DPROF" after a "make clean"); otherwise PROF_SCOPE() is *
+ * nothing at all.  Each PROF_SCOPE(id) times from where it is to the  *
+ * end of its block, so the timers nest: a game_loop turn includes the *
+ * new_map() a step off the map makes, which includes its              *
+ * dijkstra_path()s.  Time spent in a PROF_WAITING() block, waiting    *
+ * on the player, is left out of every timer running around it.       */
+typedef enum prof_id {
+  prof_new_map,
+  prof_pathfind,
+  prof_dijkstra_path,
+  prof_create_pokemon,
+  prof_init_pokemon_trainers,
+  prof_io_display,
+  prof_game_loop,
+  num_prof_ids
+} prof_id_t;
+
+/* 'P' toggles the overlay, which takes over the status lines */
+extern int prof_overlay;
+
+/* Where prof_write() puts the histograms when the game ends */
+# define PROF_FILE "poke327.prof"
+
+# ifdef PROF
+
+void prof_add(prof_id_t id, uint64_t ns);
+
+/* All the time spent in PROF_WAITING() blocks so far */
+extern uint64_t prof_waited;
+
+static inline uint64_t prof_now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+struct prof_scope {
+  prof_id_t id;
+  uint64_t start, waited;
+
+  prof_scope(prof_id_t id) : id(id), start(prof_now()), waited(prof_waited) {}
+  ~prof_scope()
+  {
+    prof_add(id, prof_now() - start - (prof_waited - waited));
+  }
+};
+
+struct prof_wait {
+  uint64_t start;
+
+  prof_wait() : start(prof_now()) {}
+  ~prof_wait() { prof_waited += prof_now() - start; }
+};
+
+#  define PROF_SCOPE(id) prof_scope prof_scope_(id)
+#  define PROF_WAITING() prof_wait prof_wait_
+# else
+#  define PROF_SCOPE(id)
+#  define PROF_WAITING()
+# endif
+
+/* Last, mean and 99th percentile of each timer on rows y and y + 1 */
+void prof_draw(int y);
+
+/* Every timer's count, mean and percentiles, then its full histogram. *
+ * Returns non-zero if path can't be written; does nothing without     *
+ * PROF.                                                               */
+int prof_write(const char *path);
+
+#endif
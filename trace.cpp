@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+
+#include "trace.h"
+
+int tracing;
+
+typedef struct trace_record {
+  const char *name, *cat;
+  uint64_t ns;         /* Since trace_start() */
+  char ph;
+} trace_record_t;
+
+/* One per thread that has traced anything.  They go on a list with a *
+ * compare-and-swap when the thread first traces and stay there, even *
+ * after their thread exits, until trace_write().                     */
+typedef struct trace_buffer {
+  trace_record_t *e;
+  uint32_t n, size;
+  pid_t tid;           /* The kernel's, so the main thread's is the pid */
+  struct trace_buffer *next;
+} trace_buffer_t;
+
+/* A million events is 32 MiB; past this, begins are dropped, and the *
+ * ends that match begins already in still go in.                     */
+#define TRACE_MAX_EVENTS (1 << 20)
+
+static std::atomic<trace_buffer_t *> trace_buffers;
+static std::atomic<uint32_t> trace_dropped;
+static thread_local trace_buffer_t *trace_buf;
+static const char *trace_path;
+static FILE *trace_file;
+static uint64_t trace_t0;
+
+static uint64_t trace_now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int trace_start(const char *path)
+{
+  if (!(trace_file = fopen(path, "w"))) {
+    perror(path);
+    return -1;
+  }
+  trace_path = path;
+  trace_t0 = trace_now();
+  tracing = 1;
+
+  return 0;
+}
+
+static trace_buffer_t *trace_buffer()
+{
+  trace_buffer_t *b;
+
+  b = (trace_buffer_t *) calloc(1, sizeof (*b));
+  b->tid = gettid();
+  b->next = trace_buffers.load();
+  while (!trace_buffers.compare_exchange_weak(b->next, b))
+    ;
+
+  return b;
+}
+
+bool trace_event(const char *name, const char *cat, char ph)
+{
+  trace_buffer_t *b;
+  trace_record_t *e;
+
+  if (!(b = trace_buf)) {
+    b = trace_buf = trace_buffer();
+  }
+  if (ph == 'B' && b->n >= TRACE_MAX_EVENTS) {
+    trace_dropped++;
+    return false;
+  }
+  if (b->n == b->size) {
+    b->size = b->size ? b->size * 2 : 4096;
+    if (!(b->e = (trace_record_t *) realloc(b->e,
+                                            b->size * sizeof (*b->e)))) {
+      perror("realloc");
+      exit(1);
+    }
+  }
+
+  e = b->e + b->n++;
+  e->name = name;
+  e->cat = cat;
+  e->ns = trace_now() - trace_t0;
+  e->ph = ph;
+
+  return true;
+}
+
+void trace_write(void)
+{
+  trace_buffer_t *b, *next;
+  FILE *f;
+  uint32_t i;
+  uint64_t n;
+  int pid;
+
+  if (!tracing) {
+    return;
+  }
+  tracing = 0;
+  f = trace_file;
+
+  pid = getpid();
+  fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+          "\"args\":{\"name\":\"poke327\"}}", pid);
+  for (n = 0, b = trace_buffers.exchange(NULL); b; b = next) {
+    next = b->next;
+    for (i = 0; i < b->n; i++) {
+      fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\","
+              "\"ts\":%llu.%03u,\"pid\":%d,\"tid\":%d}",
+              b->e[i].name, b->e[i].cat, b->e[i].ph,
+              (unsigned long long) (b->e[i].ns / 1000),
+              (unsigned) (b->e[i].ns % 1000), pid, b->tid);
+    }
+    fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+            "\"tid\":%d,\"args\":{\"name\":\"%s\"}}", pid, b->tid,
+            b->tid == pid ? "main" : "loader");
+    n += b->n;
+    free(b->e);
+    free(b);
+  }
+
+  fprintf(f, "\n]}\n");
+  fclose(f);
+
+  printf("Trace: %llu events written to %s", (unsigned long long) n,
+         trace_path);
+  if (trace_dropped) {
+    printf(", %u dropped past %d a thread", trace_dropped.load(),
+           TRACE_MAX_EVENTS);
+  }
+  printf("\n");
+}
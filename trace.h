@@ -0,0 +1,59 @@
+#ifndef TRACE_H
+# define TRACE_H
+
+# include <stdint.h>
+
+/* A timeline of what the game spent its time on, for chrome://tracing *
+ * or Perfetto: begin and end events from every thread, written out in *
+ * the Chrome trace event format.  Unlike prof.h this is always built  *
+ * in and only switched on at run time, by --trace; while it is off    *
+ * each event costs a test of tracing.                                 *
+ *                                                                     *
+ * Every thread appends to its own buffer, with no locks; the buffers  *
+ * are only read by trace_write(), once the others have finished.      *
+ * name and cat must be string constants, or at least outlive the      *
+ * trace, as only the pointers are kept.                               */
+extern int tracing;
+
+/* Turns tracing on, with the events to go to path.  Returns non-zero, *
+ * and leaves tracing off, if path can't be written.                   */
+int trace_start(const char *path);
+
+/* Returns whether the event was recorded */
+bool trace_event(const char *name, const char *cat, char ph);
+
+static inline bool trace_begin(const char *name, const char *cat)
+{
+  return tracing && trace_event(name, cat, 'B');
+}
+
+static inline void trace_end(const char *name, const char *cat)
+{
+  if (tracing) {
+    trace_event(name, cat, 'E');
+  }
+}
+
+/* A begin event now and the matching end when the block is left.  The *
+ * end goes out whenever the begin did, so the two always pair up.      */
+struct trace_scope {
+  const char *name, *cat;
+  bool on;
+
+  trace_scope(const char *name, const char *cat)
+    : name(name), cat(cat), on(trace_begin(name, cat)) {}
+  ~trace_scope()
+  {
+    if (on) {
+      trace_event(name, cat, 'E');
+    }
+  }
+};
+
+# define TRACE_SCOPE(name, cat) trace_scope trace_scope_(name, cat)
+
+/* Writes every thread's events to the path given to trace_start(), and *
+ * frees them.  Every other thread that traced must have finished.      */
+void trace_write(void);
+
+#endif
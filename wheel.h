@@ -0,0 +1,212 @@
+#ifndef WHEEL_H
+# define WHEEL_H
+
+# include <stdint.h>
+# include <stdlib.h>
+# include <assert.h>
+
+# ifdef HEAP_TRACE
+#  include "heap.h"
+# endif
+
+/* Must be 64: one bit of wheel::full per slot */
+# define WHEEL_SLOTS 64
+
+/* A timing wheel: a queue of T * for small integer keys that only ever *
+ * move forward, like turn times.  Key is a functor returning a T's     *
+ * int32_t key, which must not change while the T is queued.  Slot i    *
+ * holds the keys now + j with (now + j) % WHEEL_SLOTS == i, j < 64, in *
+ * a list threaded through the member Next points to, so insert is an   *
+ * append and remove-min is a find-first-set and an unlink.  Keys 64 or *
+ * more past now wait in later until now catches up.                    *
+ *                                                                      *
+ * Equal keys come out in the order they went in.                       *
+ * Nothing may go in below now, which is the last key taken out, or the *
+ * smallest key queued once peek_min() has had to look in later.  Like  *
+ * pqueue this is plain data; init() it before use.  destroy() forgets  *
+ * the elements without touching them.                                  */
+template <class T, class Key, T *T::*Next>
+struct wheel {
+  typedef struct list {
+    T *head;
+    T *tail;
+  } list_t;
+
+  list_t slot[WHEEL_SLOTS];
+  list_t later;
+  uint64_t full;  /* Bit i set while slot[i] is not empty */
+  int32_t now;    /* Nothing queued has a smaller key     */
+  uint32_t size;
+
+# ifdef HEAP_TRACE
+  static void (*trace)(wheel *w, heap_op_t op, T *t);
+# endif
+
+  void init()
+  {
+    clear();
+# ifdef HEAP_TRACE
+    if (trace) {
+      trace(this, heap_op_init, NULL);
+    }
+# endif
+  }
+
+  void destroy()
+  {
+# ifdef HEAP_TRACE
+    if (trace) {
+      trace(this, heap_op_delete, NULL);
+    }
+# endif
+    clear();
+  }
+
+  T *peek_min()
+  {
+    if (!size) {
+      return NULL;
+    }
+    if (!full) {
+      advance(later_min());
+    }
+
+    return slot[first()].head;
+  }
+
+  void insert(T *t)
+  {
+    int32_t k;
+
+    k = Key()(t);
+    if (!size) {
+      now = k;
+    }
+    assert(k >= now);
+    place(t, k);
+    size++;
+# ifdef HEAP_TRACE
+    if (trace) {
+      trace(this, heap_op_insert, t);
+    }
+# endif
+  }
+
+  T *remove_min()
+  {
+    uint32_t i;
+    T *t;
+
+    if (!size) {
+      return NULL;
+    }
+    if (!full) {
+      advance(later_min());
+    }
+
+    i = first();
+    t = slot[i].head;
+    if (!(slot[i].head = t->*Next)) {
+      slot[i].tail = NULL;
+      full &= ~(1ull << i);
+    }
+    t->*Next = NULL;
+    size--;
+    if (Key()(t) != now) {
+      advance(Key()(t));
+    }
+# ifdef HEAP_TRACE
+    if (trace) {
+      trace(this, heap_op_remove_min, t);
+    }
+# endif
+
+    return t;
+  }
+
+ private:
+  void clear()
+  {
+    uint32_t i;
+
+    for (i = 0; i < WHEEL_SLOTS; i++) {
+      slot[i].head = slot[i].tail = NULL;
+    }
+    later.head = later.tail = NULL;
+    full = 0;
+    now = 0;
+    size = 0;
+  }
+
+  static void append(list_t &l, T *t)
+  {
+    t->*Next = NULL;
+    if (l.tail) {
+      l.tail->*Next = t;
+    } else {
+      l.head = t;
+    }
+    l.tail = t;
+  }
+
+  void place(T *t, int32_t k)
+  {
+    if ((uint32_t) (k - now) < WHEEL_SLOTS) {
+      append(slot[k & (WHEEL_SLOTS - 1)], t);
+      full |= 1ull << (k & (WHEEL_SLOTS - 1));
+    } else {
+      append(later, t);
+    }
+  }
+
+  /* Slot of the smallest key; full must not be 0 */
+  uint32_t first() const
+  {
+    uint32_t s;
+    uint64_t r;
+
+    s = now & (WHEEL_SLOTS - 1);
+    r = s ? (full >> s) | (full << (WHEEL_SLOTS - s)) : full;
+
+    return (s + __builtin_ctzll(r)) & (WHEEL_SLOTS - 1);
+  }
+
+  int32_t later_min() const
+  {
+    int32_t k;
+    T *t;
+
+    for (k = Key()(later.head), t = later.head->*Next; t; t = t->*Next) {
+      if (Key()(t) < k) {
+        k = Key()(t);
+      }
+    }
+
+    return k;
+  }
+
+  /* Moves now up to k and brings in whatever in later is now in range. *
+   * later keeps its order, so ties that waited there still go first.  */
+  void advance(int32_t k)
+  {
+    T *t, *next;
+
+    now = k;
+    if (!later.head) {
+      return;
+    }
+    t = later.head;
+    later.head = later.tail = NULL;
+    for (; t; t = next) {
+      next = t->*Next;
+      place(t, Key()(t));
+    }
+  }
+};
+
+# ifdef HEAP_TRACE
+template <class T, class Key, T *T::*Next>
+void (*wheel<T, Key, Next>::trace)(wheel *w, heap_op_t op, T *t);
+# endif
+
+#endif